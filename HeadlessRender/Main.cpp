@@ -0,0 +1,901 @@
+/*
+//MIT License
+//
+//Copyright (c) 2022 Aaron Anderson
+*/
+#include <JuceHeader.h>
+#include "../PluginHosting/PluginStuff.h"
+#include "../PluginHosting/EngineHelpers.h"
+#include "../PluginHosting/OfflineRender.h"
+#include "../PluginHosting/BinarySession.h"
+#include "../PluginHosting/BatchRender.h"
+#include "../PluginHosting/PresetLibrary.h"
+#include "../PluginHosting/AutomationRecorder.h"
+#include "../PluginHosting/MidiInput.h"
+
+// A console counterpart to PluginHosting: loads an audio file onto track 0 the same way the
+// GUI host does, builds a plugin chain from names given on the command line and renders the
+// Edit to a WAV as fast as the machine allows.
+
+//==============================================================================
+class HeadlessEngineBehaviour : public tracktion_engine::EngineBehaviour
+{
+public:
+    HeadlessEngineBehaviour (int threads) : numThreads (threads) {}
+
+    // Nothing is played live, so there's no point opening an audio device
+    bool autoInitialiseDeviceManager() override         { return false; }
+    int getNumberOfCPUsToUseForAudio() override         { return numThreads; }
+
+private:
+    int numThreads;
+};
+
+//==============================================================================
+namespace HeadlessHelpers
+{
+    int getIntOption (const juce::ArgumentList& args, juce::StringRef option, int defaultValue)
+    {
+        if (args.containsOption (option))
+            return args.getValueForOption (option).getIntValue();
+
+        return defaultValue;
+    }
+
+    void buildChain (tracktion_engine::Edit& edit, const juce::StringArray& names)
+    {
+        auto track = EngineHelpers::getOrInsertAudioTrackAt (edit, 0);
+
+        for (auto& name : names)
+        {
+            auto plugin = createPluginByName (edit, name);
+
+            if (plugin == nullptr)
+                juce::ConsoleApplication::fail ("Couldn't find a plugin called \"" + name + "\"");
+
+            track->pluginList.insertPlugin (plugin, track->pluginList.size(), nullptr);
+            std::cout << "  + " << plugin->getName() << std::endl;
+        }
+    }
+
+    // Median wall time of running f the given number of times
+    double timeMs (int runs, const std::function<void()>& f)
+    {
+        std::vector<double> times;
+
+        for (int i = 0; i < runs; ++i)
+        {
+            const auto start = juce::Time::getMillisecondCounterHiRes();
+            f();
+            times.push_back (juce::Time::getMillisecondCounterHiRes() - start);
+        }
+
+        std::sort (times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+}
+
+//==============================================================================
+void renderCommand (const juce::ArgumentList& args)
+{
+    args.checkMinNumArguments (3);
+    const auto inputFile  = args[1].resolveAsExistingFile();
+    const auto outputFile = args[2].resolveAsFile();
+    const auto numThreads = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--threads", juce::SystemStats::getNumCpus()));
+    const auto blockSize  = juce::jmax (16, HeadlessHelpers::getIntOption (args, "--block-size", 512));
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    // Sharing the GUI host's name means sharing its settings, and so its scanned KnownPluginList
+    tracktion_engine::Engine engine { PLUGIN_HOST_NAME, nullptr, std::make_unique<HeadlessEngineBehaviour> (numThreads) };
+    tracktion_engine::Edit   edit   { tracktion_engine::Edit::Options { engine,
+                                                                        tracktion_engine::createEmptyEdit (engine),
+                                                                        tracktion_engine::ProjectItemID::createNewID (0) } };
+    engine.getPluginManager().createBuiltInType<SandboxedPlugin>();
+    engine.getPluginManager().createBuiltInType<ConvolutionPlugin>();
+
+    auto clip = EngineHelpers::loadAudioFileAsClip (edit, inputFile);
+
+    if (clip == nullptr)
+        juce::ConsoleApplication::fail ("Couldn't load " + inputFile.getFullPathName());
+
+    std::cout << "Chain:" << std::endl;
+    HeadlessHelpers::buildChain (edit, juce::StringArray::fromTokens (args.getValueForOption ("--chain"), ",", "\""));
+
+    const auto sampleRate = tracktion_engine::AudioFile (engine, inputFile).getSampleRate();
+    std::cout << "Rendering " << inputFile.getFileName() << " on " << numThreads << " thread(s)..." << std::endl;
+
+    auto result = OfflineRender::renderEdit (edit, outputFile, sampleRate, blockSize);
+
+    if (! result.ok)
+        juce::ConsoleApplication::fail (result.error);
+
+    std::cout << "Wrote " << result.file.getFullPathName() << std::endl
+              << juce::String (result.audioSeconds, 2) << " s of audio in "
+              << juce::String (result.wallSeconds, 2) << " s ("
+              << juce::String (result.getRealtimeFactor(), 1) << "x realtime)" << std::endl;
+}
+
+//==============================================================================
+// Renders every audio file in a folder through track 0's chain in a saved session. Given several
+// worker counts, the whole folder is rendered once with each and the throughput compared.
+// Each render graph gets one thread, so the parallelism comes from rendering files side by side.
+void batchCommand (const juce::ArgumentList& args)
+{
+    args.checkMinNumArguments (4);
+    const auto chainFile = args[1].resolveAsExistingFile();
+    const auto inputDir  = args[2].resolveAsExistingFolder();
+    const auto outputDir = args[3].resolveAsFile();
+    const auto blockSize = juce::jmax (16, HeadlessHelpers::getIntOption (args, "--block-size", 512));
+    auto workerCounts = juce::StringArray::fromTokens (args.containsOption ("--workers") ? args.getValueForOption ("--workers")
+                                                                                      : juce::String (juce::SystemStats::getNumCpus()), ",", {});
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    tracktion_engine::Engine engine { PLUGIN_HOST_NAME, nullptr, std::make_unique<HeadlessEngineBehaviour> (1) };
+    engine.getPluginManager().createBuiltInType<SandboxedPlugin>();
+    engine.getPluginManager().createBuiltInType<ConvolutionPlugin>();
+
+    const auto files = BatchRender::findAudioFiles (engine, inputDir);
+
+    if (files.isEmpty())
+        juce::ConsoleApplication::fail ("No audio files in " + inputDir.getFullPathName());
+
+    std::vector<std::pair<int, BatchRender::Progress>> runs;
+
+    for (auto& token : workerCounts)
+    {
+        const auto numWorkers = juce::jmax (1, token.getIntValue());
+        std::cout << "Rendering " << files.size() << " file(s) with " << numWorkers << " worker(s)..." << std::endl;
+
+        juce::String error;
+        auto result = BatchRender::run (engine, chainFile, files, outputDir, numWorkers, blockSize,
+                                        [] (const BatchRender::Progress& p)
+                                        {
+                                            std::cout << "\r  " << p.filesDone << "/" << p.numFiles << " files, "
+                                                      << juce::String (100.0 * p.audioSecondsDone / juce::jmax (0.001, p.totalAudioSeconds), 1) << "% of the audio, "
+                                                      << juce::String (p.wallSeconds, 1) << " s elapsed, ETA "
+                                                      << juce::String (p.getEtaSeconds(), 1) << " s     " << std::flush;
+                                        }, error);
+
+        if (error.isNotEmpty())
+            juce::ConsoleApplication::fail (error);
+
+        std::cout << std::endl;
+
+        if (result.filesFailed > 0)
+            std::cout << "  " << result.filesFailed << " file(s) failed" << std::endl;
+
+        runs.push_back ({ numWorkers, result });
+    }
+
+    std::cout << std::endl << "workers  audio s   wall s    audio s per wall s  speedup" << std::endl;
+
+    for (auto& [numWorkers, p] : runs)
+        std::cout << juce::String (numWorkers).paddedRight (' ', 9)
+                  << juce::String (p.audioSecondsDone, 1).paddedRight (' ', 10)
+                  << juce::String (p.wallSeconds, 2).paddedRight (' ', 10)
+                  << juce::String (p.getThroughput(), 1).paddedRight (' ', 20)
+                  << juce::String (p.getThroughput() / juce::jmax (0.001, runs.front().second.getThroughput()), 2) << "x" << std::endl;
+}
+
+//==============================================================================
+// Compares saving and loading a session as XML, as tracktion writes it, with BinarySession.
+// The session is an empty Edit's tree with plugins added to each track. The plugins carry random
+// state blobs, which is what makes real sessions with big plugins slow to parse. Only the tree
+// is timed, not creating an Edit from it, which costs the same whichever format it came from.
+void benchSessionCommand (const juce::ArgumentList& args)
+{
+    const auto numTracks        = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--tracks", 32));
+    const auto pluginsPerTrack  = juce::jmax (0, HeadlessHelpers::getIntOption (args, "--plugins", 4));
+    const auto stateKB          = juce::jmax (0, HeadlessHelpers::getIntOption (args, "--state-kb", 256));
+    const auto runs             = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--runs", 5));
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    tracktion_engine::Engine engine { PLUGIN_HOST_NAME, nullptr, std::make_unique<HeadlessEngineBehaviour> (1) };
+    tracktion_engine::Edit   edit   { tracktion_engine::Edit::Options { engine,
+                                                                        tracktion_engine::createEmptyEdit (engine),
+                                                                        tracktion_engine::ProjectItemID::createNewID (0) } };
+    edit.ensureNumberOfAudioTracks (numTracks);
+
+    auto state = edit.state.createCopy();
+    juce::Random random (1234);
+
+    for (auto track : state)
+    {
+        if (! track.hasType (tracktion_engine::IDs::TRACK))
+            continue;
+
+        for (int i = 0; i < pluginsPerTrack; ++i)
+        {
+            juce::MemoryBlock blob ((size_t) stateKB * 1024);
+            random.fillBitsRandomly (blob.getData(), blob.getSize());
+
+            juce::ValueTree plugin (tracktion_engine::IDs::PLUGIN);
+            plugin.setProperty (tracktion_engine::IDs::type, tracktion_engine::ExternalPlugin::xmlTypeName, nullptr);
+            plugin.setProperty (tracktion_engine::IDs::name, "Synthetic " + juce::String (i + 1), nullptr);
+            plugin.setProperty (tracktion_engine::IDs::id, edit.createNewItemID().toString(), nullptr);
+            plugin.setProperty (tracktion_engine::IDs::state, blob.toBase64Encoding(), nullptr);
+            track.appendChild (plugin, nullptr);
+        }
+    }
+
+    juce::TemporaryFile xmlFile (".tracktionedit"), binaryFile (BinarySession::fileExtension);
+
+    const auto xmlSave = HeadlessHelpers::timeMs (runs, [&] { state.createXml()->writeTo (xmlFile.getFile()); });
+    const auto xmlLoad = HeadlessHelpers::timeMs (runs, [&]
+                                                  {
+                                                      if (auto xml = juce::parseXML (xmlFile.getFile()))
+                                                          juce::ValueTree::fromXml (*xml);
+                                                  });
+
+    const auto binarySave = HeadlessHelpers::timeMs (runs, [&] { BinarySession::writeTree (state, binaryFile.getFile()); });
+    const auto binaryLoad = HeadlessHelpers::timeMs (runs, [&]
+                                                     {
+                                                         juce::String error;
+
+                                                         if (! BinarySession::readTree (binaryFile.getFile(), error).isValid())
+                                                             juce::ConsoleApplication::fail (error);
+                                                     });
+
+    auto row = [] (const char* name, const juce::File& f, double save, double load)
+    {
+        std::cout << juce::String (name).paddedRight (' ', 10)
+                  << (juce::String ((double) f.getSize() / (1024.0 * 1024.0), 1) + " MB").paddedRight (' ', 12)
+                  << (juce::String (save, 1) + " ms").paddedRight (' ', 14)
+                  << juce::String (load, 1) << " ms" << std::endl;
+    };
+
+    std::cout << numTracks << " tracks x " << pluginsPerTrack << " plugins x " << stateKB << " KB state, median of "
+              << runs << " runs" << std::endl << std::endl
+              << "format    size        save          load" << std::endl;
+    row ("XML", xmlFile.getFile(), xmlSave, xmlLoad);
+    row ("binary", binaryFile.getFile(), binarySave, binaryLoad);
+    std::cout << std::endl << "Binary loads " << juce::String (xmlLoad / juce::jmax (0.001, binaryLoad), 1)
+              << "x faster" << std::endl;
+}
+
+//==============================================================================
+// Compares a PresetLibrary with saving each preset as a self-contained binary tree. The presets'
+// plugin states are drawn from a smaller set of distinct random blobs, as when many presets use
+// the same sampler instrument. Loads are timed with an empty blob cache and with a warm one.
+void benchPresetsCommand (const juce::ArgumentList& args)
+{
+    const auto numPresets       = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--presets", 50));
+    const auto pluginsPerPreset = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--plugins", 4));
+    const auto numDistinct      = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--distinct", 8));
+    const auto stateKB          = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--state-kb", 4096));
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::Random random (1234);
+    std::vector<juce::String> states;
+
+    for (int i = 0; i < numDistinct; ++i)
+    {
+        juce::MemoryBlock blob ((size_t) stateKB * 1024);
+        random.fillBitsRandomly (blob.getData(), blob.getSize());
+        states.push_back (blob.toBase64Encoding());
+    }
+
+    juce::TemporaryFile libraryDir, plainDir;
+    PresetLibrary library (libraryDir.getFile());
+    plainDir.getFile().createDirectory();
+    juce::int64 plainBytes = 0;
+
+    const auto saveMs = HeadlessHelpers::timeMs (1, [&]
+    {
+        for (int p = 0; p < numPresets; ++p)
+        {
+            juce::ValueTree preset ("CHAINPRESET"), plugins ("PLUGINS");
+
+            for (int i = 0; i < pluginsPerPreset; ++i)
+            {
+                juce::ValueTree plugin (tracktion_engine::IDs::PLUGIN);
+                plugin.setProperty (tracktion_engine::IDs::type, tracktion_engine::ExternalPlugin::xmlTypeName, nullptr);
+                plugin.setProperty (tracktion_engine::IDs::name, "Synthetic " + juce::String (i + 1), nullptr);
+                plugin.setProperty (tracktion_engine::IDs::state, states[(size_t) random.nextInt (numDistinct)], nullptr);
+                plugins.appendChild (plugin, nullptr);
+            }
+
+            preset.appendChild (plugins, nullptr);
+            library.saveTree ("Preset " + juce::String (p), preset);
+
+            auto plainFile = plainDir.getFile().getChildFile ("Preset " + juce::String (p));
+            BinarySession::writeTree (preset, plainFile);
+            plainBytes += plainFile.getSize();
+        }
+    });
+
+    auto loadAll = [&] (bool cold)
+    {
+        PresetLibrary::LoadStats total;
+        std::vector<double> times;
+
+        for (int p = 0; p < numPresets; ++p)
+        {
+            if (cold)
+                library.clearCache();
+
+            PresetLibrary::LoadStats stats;
+
+            if (! library.loadTree ("Preset " + juce::String (p), stats).isValid())
+                juce::ConsoleApplication::fail ("Couldn't load preset " + juce::String (p));
+
+            times.push_back (stats.ms);
+            total.numBlobs += stats.numBlobs;
+            total.blobsFromCache += stats.blobsFromCache;
+            total.bytesRead += stats.bytesRead;
+        }
+
+        std::sort (times.begin(), times.end());
+        total.ms = times[times.size() / 2];
+        return total;
+    };
+
+    auto cold = loadAll (true);
+    auto warm = loadAll (false);
+
+    std::vector<double> plainTimes;
+
+    for (int p = 0; p < numPresets; ++p)
+    {
+        plainTimes.push_back (HeadlessHelpers::timeMs (1, [&]
+        {
+            juce::String error;
+
+            if (! BinarySession::readTree (plainDir.getFile().getChildFile ("Preset " + juce::String (p)), error).isValid())
+                juce::ConsoleApplication::fail (error);
+        }));
+    }
+
+    std::sort (plainTimes.begin(), plainTimes.end());
+    const auto storage = library.getStorageStats();
+
+    auto mb = [] (juce::int64 bytes) { return juce::String ((double) bytes / (1024.0 * 1024.0), 1) + " MB"; };
+
+    std::cout << numPresets << " presets x " << pluginsPerPreset << " plugins x " << stateKB << " KB state, drawn from "
+              << numDistinct << " distinct states" << std::endl << std::endl
+              << "Saved in " << juce::String (saveMs, 1) << " ms" << std::endl
+              << "Stored: " << mb (storage.storedBytes) << " in " << storage.numBlobs << " blobs, for " << mb (storage.logicalBytes)
+              << " of presets (" << juce::String (storage.getSavedFraction() * 100.0, 1) << "% saved); self-contained files take "
+              << mb (plainBytes) << std::endl << std::endl
+              << "load                 median ms   blobs cached   read" << std::endl;
+
+    auto row = [&] (const char* name, double ms, const juce::String& cached, const juce::String& read)
+    {
+        std::cout << juce::String (name).paddedRight (' ', 21)
+                  << juce::String (ms, 2).paddedRight (' ', 12)
+                  << cached.paddedRight (' ', 15)
+                  << read << std::endl;
+    };
+
+    row ("self-contained", plainTimes[plainTimes.size() / 2], "-", mb (plainBytes));
+    row ("library, cold cache", cold.ms, juce::String (cold.blobsFromCache) + "/" + juce::String (cold.numBlobs), mb (cold.bytesRead));
+    row ("library, warm cache", warm.ms, juce::String (warm.blobsFromCache) + "/" + juce::String (warm.numBlobs), mb (warm.bytesRead));
+
+    libraryDir.getFile().deleteRecursively();
+    plainDir.getFile().deleteRecursively();
+}
+
+//==============================================================================
+// Measures AutomationRecorder's pipeline on synthetic moves of many parameters at once: how fast
+// the capture queue takes them, how far thinning shrinks them, how much the written curves take
+// per minute, and what playing the curves back costs, as the difference between rendering track 0
+// with the curves and without them. Every parameter moves the whole time, which is the worst case.
+void benchAutomationCommand (const juce::ArgumentList& args)
+{
+    const auto numParams  = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--params", 200));
+    const auto seconds    = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--seconds", 60));
+    const auto rateHz     = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--rate", 100));
+    const auto tolerance  = (float) (args.containsOption ("--tolerance") ? args.getValueForOption ("--tolerance").getDoubleValue() : 0.5) / 100.0f;
+    const auto sampleRate = 48000.0;
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    tracktion_engine::Engine engine { PLUGIN_HOST_NAME, nullptr, std::make_unique<HeadlessEngineBehaviour> (1) };
+    tracktion_engine::Edit   edit   { tracktion_engine::Edit::Options { engine,
+                                                                        tracktion_engine::createEmptyEdit (engine),
+                                                                        tracktion_engine::ProjectItemID::createNewID (0) } };
+
+    // Something to play through the plugins
+    juce::TemporaryFile toneFile (".wav"), renderFile (".wav");
+    {
+        juce::AudioBuffer<float> tone (2, (int) sampleRate * seconds);
+
+        for (int i = 0; i < tone.getNumSamples(); ++i)
+            tone.setSample (0, i, 0.25f * std::sin (juce::MathConstants<float>::twoPi * 220.0f * (float) i / (float) sampleRate));
+
+        tone.copyFrom (1, 0, tone, 0, 0, tone.getNumSamples());
+
+        if (auto writer = std::unique_ptr<juce::AudioFormatWriter> (juce::WavAudioFormat().createWriterFor (new juce::FileOutputStream (toneFile.getFile()),
+                                                                                                            sampleRate, 2, 24, {}, 0)))
+            writer->writeFromAudioSampleBuffer (tone, 0, tone.getNumSamples());
+    }
+
+    if (EngineHelpers::loadAudioFileAsClip (edit, toneFile.getFile()) == nullptr)
+        juce::ConsoleApplication::fail ("Couldn't write the test tone");
+
+    auto track = EngineHelpers::getOrInsertAudioTrackAt (edit, 0);
+    const juce::StringArray pluginTypes { tracktion_engine::EqualiserPlugin::xmlTypeName, tracktion_engine::CompressorPlugin::xmlTypeName,
+                                          tracktion_engine::ChorusPlugin::xmlTypeName, tracktion_engine::PhaserPlugin::xmlTypeName,
+                                          tracktion_engine::DelayPlugin::xmlTypeName, tracktion_engine::LowPassPlugin::xmlTypeName };
+    juce::Array<tracktion_engine::AutomatableParameter*> params;
+
+    for (int i = 0; params.size() < numParams; ++i)
+    {
+        auto plugin = edit.getPluginCache().createNewPlugin (pluginTypes[i % pluginTypes.size()], {});
+        track->pluginList.insertPlugin (plugin, track->pluginList.size(), nullptr);
+
+        for (auto p : plugin->getAutomatableParameters())
+            if (params.size() < numParams)
+                params.add (p);
+    }
+
+    // Slow sweeps with a little jitter, as a hand on a knob makes
+    juce::Random random (1234);
+    std::vector<std::vector<AutomationRecorder::Point>> moves ((size_t) params.size());
+    const auto numEvents = seconds * rateHz;
+
+    for (auto& m : moves)
+    {
+        const auto rate = 0.05 + 0.45 * random.nextDouble(), phase = random.nextDouble() * juce::MathConstants<double>::twoPi;
+
+        for (int i = 0; i < numEvents; ++i)
+        {
+            const auto t = (double) i / rateHz;
+            m.push_back ({ t, juce::jlimit (0.0f, 1.0f, (float) (0.5 + 0.4 * std::sin (juce::MathConstants<double>::twoPi * rate * t + phase))
+                                                          + 0.002f * (random.nextFloat() - 0.5f)) });
+        }
+    }
+
+    // Capture: every move through the queue, pushed from one thread and drained on another
+    const auto totalEvents = (juce::int64) numEvents * params.size();
+    MultiProducerQueue<AutomationRecorder::Point> queue (65536);
+    const auto captureMs = HeadlessHelpers::timeMs (1, [&]
+    {
+        std::thread producer ([&]
+                              {
+                                  for (auto& m : moves)
+                                      for (auto& p : m)
+                                          while (! queue.push (p))
+                                              std::this_thread::yield();
+                              });
+
+        AutomationRecorder::Point p;
+
+        for (juce::int64 n = 0; n < totalEvents;)
+            if (queue.pop (p))
+                ++n;
+
+        producer.join();
+    });
+
+    std::vector<std::vector<AutomationRecorder::Point>> thinned;
+    const auto thinMs = HeadlessHelpers::timeMs (1, [&]
+    {
+        for (auto& m : moves)
+            thinned.push_back (AutomationRecorder::thin (m, tolerance));
+    });
+
+    size_t keptPoints = 0, curveBytes = 0;
+
+    for (int i = 0; i < params.size(); ++i)
+    {
+        AutomationRecorder::writeToCurve (*params[i], thinned[(size_t) i]);
+        keptPoints += thinned[(size_t) i].size();
+        curveBytes += AutomationRecorder::getCurveBytes (*params[i]);
+    }
+
+    auto withCurves = OfflineRender::renderEdit (edit, renderFile.getFile(), sampleRate, 512);
+
+    for (auto p : params)
+        p->getCurve().removePointsInRegion ({ 0.0, (double) seconds + 1.0 });
+
+    auto withoutCurves = OfflineRender::renderEdit (edit, renderFile.getFile(), sampleRate, 512);
+
+    if (! withCurves.ok || ! withoutCurves.ok)
+        juce::ConsoleApplication::fail (withCurves.ok ? withoutCurves.error : withCurves.error);
+
+    const auto minutes = seconds / 60.0;
+    const auto rawBytes = (double) totalEvents * sizeof (AutomationRecorder::Point);
+    const auto extraMs = 1000.0 * (withCurves.wallSeconds - withoutCurves.wallSeconds);
+
+    std::cout << params.size() << " parameters moving for " << seconds << " s at " << rateHz << " Hz, tolerance "
+              << juce::String (tolerance * 100.0f, 2) << "%" << std::endl << std::endl
+              << "capture   " << totalEvents << " moves through the queue in " << juce::String (captureMs, 1) << " ms ("
+              << juce::String (1.0e6 * captureMs / (double) totalEvents, 1) << " ns each)" << std::endl
+              << "thinning  " << keptPoints << " points kept (" << juce::String (100.0 * (double) keptPoints / (double) totalEvents, 2)
+              << "%) in " << juce::String (thinMs, 1) << " ms" << std::endl
+              << "memory    " << juce::File::descriptionOfSizeInBytes ((juce::int64) (rawBytes / minutes)) << " per minute raw, "
+              << juce::File::descriptionOfSizeInBytes ((juce::int64) ((double) curveBytes / minutes)) << " per minute as curves" << std::endl
+              << "playback  " << juce::String (withCurves.wallSeconds * 1000.0, 1) << " ms to render with the curves, "
+              << juce::String (withoutCurves.wallSeconds * 1000.0, 1) << " ms without: "
+              << juce::String (100.0 * extraMs / (1000.0 * seconds), 3) << "% of realtime for the automation" << std::endl;
+}
+
+//==============================================================================
+// Measures MIDI in to audio out latency and jitter through track 0, with a virtual MIDI port
+// standing in for a keyboard and tracktion's hosted audio device standing in for a sound card.
+// A thread plays the part of the device, asking for a block every block period. MidiProbePlugin
+// on track 0 marks the sample each note-on was placed at. Each block is taken to be heard one
+// period after it was asked for, as with a double-buffered device, so a note's latency is from
+// sending it to when its marked sample would have been heard.
+void midiLatencyCommand (const juce::ArgumentList& args)
+{
+    const auto numNotes   = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--notes", 200));
+    const auto blockSize  = juce::jmax (16, HeadlessHelpers::getIntOption (args, "--block-size", 256));
+    const auto sampleRate = (double) juce::jmax (8000, HeadlessHelpers::getIntOption (args, "--sample-rate", 48000));
+    const auto blockMs    = 1000.0 * blockSize / sampleRate;
+    const juce::String probeName ("Headless Render Latency Probe");
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    auto probe = juce::MidiOutput::createNewDevice (probeName);
+
+    if (probe == nullptr)
+        juce::ConsoleApplication::fail ("Couldn't create a virtual MIDI port; they're only supported on macOS, iOS and Linux");
+
+    tracktion_engine::Engine engine { PLUGIN_HOST_NAME, nullptr, std::make_unique<HeadlessEngineBehaviour> (1) };
+    engine.getPluginManager().createBuiltInType<MidiProbePlugin>();
+
+    auto& hosted = engine.getDeviceManager().getHostedAudioDeviceInterface();
+    tracktion_engine::HostedAudioDeviceInterface::Parameters deviceParams;
+    deviceParams.sampleRate = sampleRate;
+    deviceParams.blockSize = blockSize;
+    deviceParams.fixedBlockSize = true;
+    deviceParams.inputChannels = 0;
+    deviceParams.outputChannels = 2;
+    hosted.initialise (deviceParams);
+    hosted.prepareToPlay (sampleRate, blockSize);
+
+    tracktion_engine::Edit edit { tracktion_engine::Edit::Options { engine,
+                                                                    tracktion_engine::createEmptyEdit (engine),
+                                                                    tracktion_engine::ProjectItemID::createNewID (0) } };
+    auto track = EngineHelpers::getOrInsertAudioTrackAt (edit, 0);
+    track->pluginList.insertPlugin (edit.getPluginCache().createNewPlugin (MidiProbePlugin::xmlTypeName, {}), 0, nullptr);
+
+    // Let the engine find the new port
+    engine.getDeviceManager().rescanMidiDeviceList();
+    juce::MessageManager::getInstance()->runDispatchLoopUntil (1000);
+
+    MidiInputRouter router (edit);
+
+    if (! router.getRoutedDevices().contains (probeName))
+        juce::ConsoleApplication::fail ("The engine didn't see the virtual MIDI port");
+
+    std::atomic<bool> running { true };
+    std::vector<double> heardMs;
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+
+    std::thread device ([&]
+                        {
+                            juce::AudioBuffer<float> buffer (2, blockSize);
+                            juce::MidiBuffer midi;
+                            bool wasHigh = false;
+
+                            for (juce::int64 n = 0; running; ++n)
+                            {
+                                const auto due = start + (double) n * blockMs;
+
+                                while (juce::Time::getMillisecondCounterHiRes() < due)
+                                    if (due - juce::Time::getMillisecondCounterHiRes() > 2.0)
+                                        juce::Thread::sleep (1);
+
+                                buffer.clear();
+                                midi.clear();
+                                hosted.processBlock (buffer, midi);
+
+                                for (int i = 0; i < blockSize; ++i)
+                                {
+                                    const auto high = std::abs (buffer.getSample (0, i)) > 0.1f;
+
+                                    if (high && ! wasHigh)
+                                        heardMs.push_back (start + (double) (n + 1) * blockMs + 1000.0 * i / sampleRate);
+
+                                    wasHigh = high;
+                                }
+                            }
+                        });
+
+    // Irregular gaps, so the notes land all over the block
+    juce::Random random (1234);
+    std::vector<double> sentMs;
+    juce::MessageManager::getInstance()->runDispatchLoopUntil (500);
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        sentMs.push_back (juce::Time::getMillisecondCounterHiRes());
+        probe->sendMessageNow (juce::MidiMessage::noteOn (1, 60, (juce::uint8) 100));
+        juce::MessageManager::getInstance()->runDispatchLoopUntil (20);
+        probe->sendMessageNow (juce::MidiMessage::noteOff (1, 60));
+        juce::MessageManager::getInstance()->runDispatchLoopUntil (40 + random.nextInt (80));
+    }
+
+    juce::MessageManager::getInstance()->runDispatchLoopUntil (500);
+    running = false;
+    device.join();
+
+    // Each note is matched with the first mark heard after it was sent
+    std::vector<double> latencies;
+    size_t mark = 0;
+
+    for (auto sent : sentMs)
+    {
+        while (mark < heardMs.size() && heardMs[mark] < sent)
+            ++mark;
+
+        if (mark < heardMs.size() && heardMs[mark] - sent < 500.0)
+            latencies.push_back (heardMs[mark++] - sent);
+    }
+
+    if (latencies.empty())
+        juce::ConsoleApplication::fail ("No notes came out of track 0");
+
+    double sum = 0.0, sumSquares = 0.0;
+
+    for (auto l : latencies)
+    {
+        sum += l;
+        sumSquares += l * l;
+    }
+
+    const auto mean = sum / (double) latencies.size();
+    const auto jitter = std::sqrt (juce::jmax (0.0, sumSquares / (double) latencies.size() - mean * mean));
+    std::sort (latencies.begin(), latencies.end());
+    auto percentile = [&] (double p) { return latencies[juce::jmin (latencies.size() - 1, (size_t) (p * (double) latencies.size()))]; };
+
+    std::cout << latencies.size() << " of " << numNotes << " notes heard, " << blockSize << " sample blocks at " << sampleRate
+              << " Hz (" << juce::String (blockMs, 2) << " ms)" << std::endl << std::endl
+              << "min     median  mean    p99     max     jitter (std dev, ms)" << std::endl
+              << juce::String (latencies.front(), 2).paddedRight (' ', 8)
+              << juce::String (percentile (0.5), 2).paddedRight (' ', 8)
+              << juce::String (mean, 2).paddedRight (' ', 8)
+              << juce::String (percentile (0.99), 2).paddedRight (' ', 8)
+              << juce::String (latencies.back(), 2).paddedRight (' ', 8)
+              << juce::String (jitter, 3) << std::endl << std::endl
+              << "Notes placed at the start of each block would jitter by about " << juce::String (blockMs / std::sqrt (12.0), 2)
+              << " ms; much less means they're placed at the sample they arrived." << std::endl;
+}
+
+//==============================================================================
+// Sandboxed plugins launched by this executable run here
+void pluginSandboxCommand (const juce::ArgumentList& args)
+{
+    args.checkMinNumArguments (2);
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    if (! PluginSandbox::runChild (args[1].resolveAsFile()))
+        juce::ConsoleApplication::fail ("Couldn't open " + args[1].text);
+}
+
+// Compares processing blocks with PluginSandbox's test gain in this process and in a sandbox.
+// The gain costs next to nothing, so the sandboxed times are almost all round trip: copying the
+// block into shared memory, waking the child, being woken by it, and copying the block back.
+void benchSandboxCommand (const juce::ArgumentList& args)
+{
+    if (! PluginSandbox::isSupported)
+        juce::ConsoleApplication::fail ("Sandboxed plugins aren't available on this platform");
+
+    const auto numBlocks  = juce::jmax (1, HeadlessHelpers::getIntOption (args, "--blocks", 20000));
+    const auto blockSize  = juce::jlimit (16, PluginSandbox::maxBlockSize, HeadlessHelpers::getIntOption (args, "--block-size", 256));
+    const auto sampleRate = (double) juce::jmax (8000, HeadlessHelpers::getIntOption (args, "--sample-rate", 48000));
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::AudioBuffer<float> buffer (PluginSandbox::maxChannels, blockSize);
+    juce::MidiBuffer midi;
+    juce::Random random (1234);
+
+    auto fill = [&]
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                buffer.setSample (ch, i, random.nextFloat() * 2.0f - 1.0f);
+    };
+
+    // Per-block times in microseconds, plus the CPU time this process used while taking them
+    struct Run
+    {
+        std::vector<double> blockUs;
+        double cpuMs = 0.0;
+        int failed = 0;
+    };
+
+    auto time = [&] (const std::function<bool()>& processBlock)
+    {
+        Run run;
+        const auto cpuStart = std::clock();
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            fill();
+            const auto start = juce::Time::getHighResolutionTicks();
+
+            if (! processBlock())
+                ++run.failed;
+
+            run.blockUs.push_back (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1.0e6);
+        }
+
+        run.cpuMs = 1000.0 * (double) (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        std::sort (run.blockUs.begin(), run.blockUs.end());
+        return run;
+    };
+
+    PluginSandbox::TestGainProcessor inProcess;
+    inProcess.prepareToPlay (sampleRate, blockSize);
+    auto local = time ([&] { inProcess.processBlock (buffer, midi); return true; });
+
+    PluginSandbox::Host host;
+    host.start (PluginSandbox::getTestPluginDescription(), {}, sampleRate, blockSize);
+
+    if (! host.waitUntilReady (PluginSandbox::loadTimeoutMs))
+        juce::ConsoleApplication::fail (host.hasFailed() ? host.getError() : "The sandbox didn't start");
+
+    const auto blockMs = 1000.0 * blockSize / sampleRate;
+    auto sandboxed = time ([&] { return host.process (buffer, 0, blockSize, midi, blockMs); });
+
+    auto row = [&] (const char* name, const Run& r)
+    {
+        double sum = 0.0;
+
+        for (auto t : r.blockUs)
+            sum += t;
+
+        auto percentile = [&r] (double p) { return r.blockUs[juce::jmin (r.blockUs.size() - 1, (size_t) (p * (double) r.blockUs.size()))]; };
+
+        std::cout << juce::String (name).paddedRight (' ', 12)
+                  << juce::String (sum / (double) r.blockUs.size(), 2).paddedRight (' ', 10)
+                  << juce::String (percentile (0.5), 2).paddedRight (' ', 10)
+                  << juce::String (percentile (0.99), 2).paddedRight (' ', 10)
+                  << juce::String (r.blockUs.back(), 2).paddedRight (' ', 10)
+                  << juce::String (r.cpuMs, 1).paddedRight (' ', 10)
+                  << r.failed << std::endl;
+    };
+
+    std::cout << numBlocks << " blocks of " << blockSize << " samples at " << sampleRate << " Hz ("
+              << juce::String (blockMs, 2) << " ms per block)" << std::endl << std::endl
+              << "            mean us   median us p99 us    max us    host CPU ms  timeouts" << std::endl;
+    row ("in-process", local);
+    row ("sandboxed", sandboxed);
+    std::cout << std::endl << "Host CPU doesn't include the sandbox child's own time" << std::endl;
+}
+
+//==============================================================================
+// Checks PartitionedConvolver against direct time-domain convolution of the same signal and
+// times both. The impulse response is exponentially decaying noise, like a real room. The
+// direct reference is one vectorised multiply-add per tap over the whole signal, so it's about
+// as fast as time-domain convolution gets.
+void benchConvolutionCommand (const juce::ArgumentList& args)
+{
+    const auto sampleRate    = (double) juce::jmax (8000, HeadlessHelpers::getIntOption (args, "--sample-rate", 48000));
+    const auto irSeconds     = args.containsOption ("--ir-seconds") ? args.getValueForOption ("--ir-seconds").getDoubleValue() : 2.0;
+    const auto irLength      = juce::jmax (1, (int) (sampleRate * irSeconds));
+    const auto numSamples    = (int) (sampleRate * juce::jmax (1, HeadlessHelpers::getIntOption (args, "--seconds", 2)));
+    const auto partitionSize = HeadlessHelpers::getIntOption (args, "--partition", ConvolutionPlugin::partitionSize);
+    auto blockSizes = juce::StringArray::fromTokens (args.containsOption ("--block-sizes") ? args.getValueForOption ("--block-sizes")
+                                                                                          : juce::String ("32,64,128,256,512,1024"), ",", {});
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::Random random (1234);
+    std::vector<float> ir ((size_t) irLength), input ((size_t) numSamples), reference ((size_t) numSamples, 0.0f);
+
+    for (int i = 0; i < irLength; ++i)
+        ir[(size_t) i] = (random.nextFloat() * 2.0f - 1.0f) * std::exp (-6.9f * (float) i / (float) irLength) * 0.05f;
+
+    for (auto& x : input)
+        x = random.nextFloat() * 2.0f - 1.0f;
+
+    const auto audioMs = 1000.0 * numSamples / sampleRate;
+    const auto directMs = HeadlessHelpers::timeMs (1, [&]
+    {
+        for (int m = 0; m < juce::jmin (irLength, numSamples); ++m)
+            juce::FloatVectorOperations::addWithMultiply (reference.data() + m, input.data(), ir[(size_t) m], numSamples - m);
+    });
+
+    std::cout << juce::String (irLength / sampleRate, 2) << " s impulse response (" << irLength << " taps), "
+              << juce::String (audioMs / 1000.0, 2) << " s of audio at " << sampleRate << " Hz" << std::endl << std::endl
+              << "direct: " << juce::String (directMs, 1) << " ms (" << juce::String (audioMs / directMs, 2) << "x realtime)" << std::endl << std::endl
+              << "block   mean us   max us    budget    realtime  max error" << std::endl;
+
+    std::vector<float> output ((size_t) numSamples);
+
+    for (auto& token : blockSizes)
+    {
+        const auto blockSize = juce::jmax (1, token.getIntValue());
+        PartitionedConvolver convolver (ir.data(), irLength, partitionSize, blockSize);
+        std::vector<double> blockUs;
+
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            const auto num = juce::jmin (blockSize, numSamples - start);
+            const auto t = juce::Time::getHighResolutionTicks();
+            convolver.process (input.data() + start, output.data() + start, num);
+            blockUs.push_back (juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - t) * 1.0e6);
+        }
+
+        double totalUs = 0.0, maxUs = 0.0, maxError = 0.0;
+
+        for (auto us : blockUs)
+        {
+            totalUs += us;
+            maxUs = juce::jmax (maxUs, us);
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            maxError = juce::jmax (maxError, (double) std::abs (output[(size_t) i] - reference[(size_t) i]));
+
+        const auto meanUs = totalUs / (double) blockUs.size();
+        const auto blockUsAvailable = 1.0e6 * blockSize / sampleRate;
+
+        std::cout << juce::String (blockSize).paddedRight (' ', 8)
+                  << juce::String (meanUs, 2).paddedRight (' ', 10)
+                  << juce::String (maxUs, 2).paddedRight (' ', 10)
+                  << (juce::String (100.0 * meanUs / blockUsAvailable, 2) + "%").paddedRight (' ', 10)
+                  << (juce::String (audioMs * 1000.0 / totalUs, 1) + "x").paddedRight (' ', 10)
+                  << juce::String (maxError, 8) << std::endl;
+    }
+
+    std::cout << std::endl << "Partitions of " << partitionSize << " samples; the convolver adds no latency at any block size."
+              << std::endl << "Blocks that end a partition do the FFT work, so max us is set by the partition, not the block." << std::endl;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "Usage:", true);
+    app.addCommand ({ "--render",
+                      "--render <input> <output.wav> [--chain name,name,...] [--threads n] [--block-size n]",
+                      "Renders an audio file through a plugin chain, faster than realtime",
+                      "Loads <input> onto track 0, inserts the named plugins in order and renders the Edit to <output.wav>.\n"
+                      "--threads sets how many cores the render graph may use (default: all of them).",
+                      renderCommand });
+    app.addCommand ({ "--batch",
+                      "--batch <session> <input folder> <output folder> [--workers n,n,...] [--block-size n]",
+                      "Renders every audio file in a folder through a saved chain, several at a time",
+                      "Renders each file through track 0's plugins in <session>, saved by the host's Save button, to a WAV of\n"
+                      "the same name in <output folder>. Each worker renders one file at a time with its own copy of the chain.\n"
+                      "With several worker counts the folder is rendered once per count and the throughputs are compared.",
+                      batchCommand });
+    app.addCommand ({ "--bench-session",
+                      "--bench-session [--tracks n] [--plugins n] [--state-kb n] [--runs n]",
+                      "Compares saving and loading a session as XML and in the binary session format",
+                      "Builds a session with the given number of tracks, each with plugins carrying random state of the given size,\n"
+                      "and reports file sizes and median save and load times for both formats.",
+                      benchSessionCommand });
+    app.addCommand ({ "--bench-presets",
+                      "--bench-presets [--presets n] [--plugins n] [--distinct n] [--state-kb n]",
+                      "Compares the content-addressed preset library with self-contained preset files",
+                      "Saves presets whose plugin states are drawn from a smaller set of distinct blobs, and reports the storage\n"
+                      "each way takes and median load times from self-contained files and from the library, cold and warm.",
+                      benchPresetsCommand });
+    app.addCommand ({ "--bench-automation",
+                      "--bench-automation [--params n] [--seconds n] [--rate n] [--tolerance percent]",
+                      "Measures recording, thinning and playing back automation of many parameters",
+                      "Moves the given number of built-in plugin parameters at <rate> changes per second, pushes the moves through\n"
+                      "the capture queue, thins them to curves and reports the points kept, memory per minute and playback cost.",
+                      benchAutomationCommand });
+    app.addCommand ({ "--midi-latency",
+                      "--midi-latency [--notes n] [--block-size n] [--sample-rate n]",
+                      "Measures MIDI in to audio out latency and jitter through track 0",
+                      "Sends notes through a virtual MIDI port to a probe plugin on track 0, with a paced stand-in for an audio\n"
+                      "device, and reports how long after each note was sent its first sample would have been heard.",
+                      midiLatencyCommand });
+    app.addCommand ({ "--bench-sandbox",
+                      "--bench-sandbox [--blocks n] [--block-size n] [--sample-rate n]",
+                      "Measures the cost of running a plugin in a sandbox process",
+                      "Processes blocks with a built-in test gain in this process and then in a sandbox child,\n"
+                      "and reports per-block times, this process's CPU time and any blocks the sandbox didn't answer in time.",
+                      benchSandboxCommand });
+    app.addCommand ({ "--bench-convolution",
+                      "--bench-convolution [--ir-seconds n] [--seconds n] [--partition n] [--block-sizes n,n,...] [--sample-rate n]",
+                      "Measures the convolution reverb against direct time-domain convolution",
+                      "Convolves noise with a decaying noise impulse response directly and with the partitioned convolver at each\n"
+                      "block size, and reports per-block times, the share of each block's time used and the largest difference.",
+                      benchConvolutionCommand });
+    app.addCommand ({ PluginSandbox::childProcessOption,
+                      juce::String (PluginSandbox::childProcessOption) + " <shared file>",
+                      "Used internally to run a sandboxed plugin",
+                      {},
+                      pluginSandboxCommand });
+
+    return app.findAndRunCommand (argc, argv);
+}
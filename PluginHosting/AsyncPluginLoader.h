@@ -0,0 +1,70 @@
+#pragma once
+
+//==============================================================================
+// Loads plugins behind a placeholder, so choosing one never holds up the click that chose it.
+//
+// tracktion's ExternalPlugin builds its AudioPluginInstance itself, on the message thread, and
+// there's no way to hand it one made elsewhere. Building one on a background thread doesn't help
+// either: JUCE hands that call back to the message thread and blocks the caller until it's done.
+// So external plugins are still created on the message thread, but on a later iteration of the
+// message loop, after the placeholder taking their slot has been drawn. Built-in plugins are
+// cheap and are created straight away, as are plugins still in the pool and sandboxed plugins,
+// which load in their own process.
+class AsyncPluginLoader
+{
+public:
+    // Called on the message thread, with nullptr if the plugin couldn't be created
+    using Callback = std::function<void (tracktion_engine::Plugin::Ptr)>;
+
+    AsyncPluginLoader (tracktion_engine::Edit& e, PluginInstancePool& p) : edit (e), pool (p) {}
+
+    void load (const juce::PluginDescription& desc, const juce::String& xmlType, Callback onLoaded)
+    {
+        if (xmlType == tracktion_engine::ExternalPlugin::xmlTypeName && PluginSandbox::isEnabled())
+        {
+            onLoaded (SandboxedPlugin::create (edit, desc));
+            return;
+        }
+
+        if (auto pooled = pool.acquire (desc, xmlType))
+        {
+            onLoaded (pooled);
+            return;
+        }
+
+        if (xmlType != tracktion_engine::ExternalPlugin::xmlTypeName)
+        {
+            onLoaded (edit.getPluginCache().createNewPlugin (xmlType, desc));
+            return;
+        }
+
+        juce::MessageManager::callAsync ([ref = juce::WeakReference<AsyncPluginLoader> (this), desc, xmlType, onLoaded]
+                                         {
+                                             if (auto l = ref.get())
+                                                 onLoaded (l->edit.getPluginCache().createNewPlugin (xmlType, desc));
+                                         });
+    }
+
+private:
+    tracktion_engine::Edit& edit;
+    PluginInstancePool& pool;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (AsyncPluginLoader)
+    JUCE_DECLARE_NON_COPYABLE (AsyncPluginLoader)
+};
+
+//==============================================================================
+// Takes a plugin's slot in the chain view while it loads
+class PluginPlaceholderComponent : public juce::TextButton
+{
+public:
+    PluginPlaceholderComponent (const juce::String& pluginName)
+    {
+        setButtonText ("...");
+        setTooltip ("Loading " + pluginName);
+        setEnabled (false);
+    }
+
+    tracktion_engine::Plugin::Ptr plugin;
+    bool finished = false;
+};
@@ -0,0 +1,501 @@
+#pragma once
+
+//==============================================================================
+// A bounded queue that any number of threads can push to and one thread pops from, without
+// locks. Each slot carries a sequence number that says whether it's free to write or ready to
+// read (after Dmitry Vyukov's bounded queue). Pushing to a full queue fails rather than waits.
+template <typename Item>
+class MultiProducerQueue
+{
+public:
+    explicit MultiProducerQueue (int capacity)
+        : size ((size_t) juce::nextPowerOfTwo (juce::jmax (2, capacity))),
+          slots (new Slot[size])
+    {
+        for (size_t i = 0; i < size; ++i)
+            slots[i].sequence.store (i, std::memory_order_relaxed);
+    }
+
+    bool push (const Item& item)
+    {
+        auto pos = head.load (std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto& slot = slots[pos & (size - 1)];
+            const auto diff = (std::ptrdiff_t) slot.sequence.load (std::memory_order_acquire) - (std::ptrdiff_t) pos;
+
+            if (diff == 0)
+            {
+                if (head.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.item = item;
+                    slot.sequence.store (pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                numDropped.fetch_add (1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = head.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Only ever called from the one consumer thread
+    bool pop (Item& item)
+    {
+        auto& slot = slots[tail & (size - 1)];
+
+        if ((std::ptrdiff_t) slot.sequence.load (std::memory_order_acquire) - (std::ptrdiff_t) (tail + 1) < 0)
+            return false;
+
+        item = slot.item;
+        slot.sequence.store (tail + size, std::memory_order_release);
+        ++tail;
+        return true;
+    }
+
+    int getNumDropped() const       { return numDropped.load(); }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence { 0 };
+        Item item {};
+    };
+
+    const size_t size;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> head { 0 };
+    size_t tail = 0;
+    std::atomic<int> numDropped { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (MultiProducerQueue)
+};
+
+//==============================================================================
+// Automation write mode for the plugins on track 0.
+//
+// While it's enabled and the transport plays, every change made to a parameter of a track 0
+// plugin (by its editor, or by the plugin itself, but not by automation playback) is pushed onto
+// a MultiProducerQueue, stamped with the wall clock time. That's all that happens on the thread
+// making the change, so it's safe from the audio thread too.
+//
+// A background thread drains the queue into one segment per parameter. A segment ends with the
+// gesture, or after a pause, or when the transport stops. It's then mapped from wall clock to
+// Edit time, using the transport positions sampled on the message thread, and thinned: only the
+// points needed to keep every recorded value within tolerance of the straight lines between
+// them are kept (Ramer-Douglas-Peucker, with vertical error in normalised units). The kept
+// points replace whatever the parameter's curve had over that stretch, on the message thread,
+// and tracktion plays the curve back like any other automation.
+class AutomationRecorder : private juce::Thread,
+                           private juce::Timer,
+                           private tracktion_engine::AutomatableParameter::Listener
+{
+public:
+    struct Point
+    {
+        double time = 0.0;
+        float value = 0.0f;     // normalised
+    };
+
+    struct PassStats
+    {
+        int numParameters = 0, rawEvents = 0, keptPoints = 0, droppedEvents = 0;
+        double seconds = 0.0;
+        size_t curveBytes = 0;      // the points this pass wrote, as they'd be saved
+
+        double getBytesPerMinute() const    { return seconds > 0.0 ? 60.0 * (double) curveBytes / seconds : 0.0; }
+    };
+
+    static constexpr const char* toleranceSetting = "automationTolerancePercent";
+
+    AutomationRecorder (tracktion_engine::Edit& e)
+        : juce::Thread ("Automation Thinning"), edit (e)
+    {
+        if (auto settings = tracktion_engine::getApplicationSettings())
+            setTolerance ((float) settings->getDoubleValue (toleranceSetting, 0.5) / 100.0f);
+    }
+
+    ~AutomationRecorder() override
+    {
+        stopTimer();
+        detach();
+        stopThread (2000);
+    }
+
+    void setWriteEnabled (bool shouldWrite)
+    {
+        if (shouldWrite == isTimerRunning())
+            return;
+
+        if (shouldWrite)
+        {
+            startThread();
+            startTimerHz (timelineHz);
+        }
+        else
+        {
+            stopTimer();
+            endPass();
+        }
+    }
+
+    bool isWriteEnabled() const                 { return isTimerRunning(); }
+
+    // The largest error allowed, as a proportion of each parameter's range
+    void setTolerance (float proportion)        { tolerance = juce::jlimit (0.0f, 1.0f, proportion); }
+    float getTolerance() const                  { return tolerance; }
+
+    // Called on the message thread when a pass ends and all of its curves have been written
+    std::function<void (const PassStats&)> onPassFinished;
+
+    //==============================================================================
+    static std::vector<Point> thin (const std::vector<Point>& points, float tolerance)
+    {
+        if (points.size() <= 2)
+            return points;
+
+        std::vector<bool> keep (points.size(), false);
+        keep.front() = keep.back() = true;
+        std::vector<std::pair<size_t, size_t>> spans { { 0, points.size() - 1 } };
+
+        while (! spans.empty())
+        {
+            const auto [a, b] = spans.back();
+            spans.pop_back();
+
+            const auto& pa = points[a];
+            const auto& pb = points[b];
+            const auto dt = pb.time - pa.time;
+            float worst = 0.0f;
+            size_t worstIndex = a;
+
+            for (auto i = a + 1; i < b; ++i)
+            {
+                const auto t = dt > 0.0 ? (float) ((points[i].time - pa.time) / dt) : 0.0f;
+                const auto error = std::abs (points[i].value - (pa.value + t * (pb.value - pa.value)));
+
+                if (error > worst)
+                {
+                    worst = error;
+                    worstIndex = i;
+                }
+            }
+
+            if (worst > tolerance)
+            {
+                keep[worstIndex] = true;
+                spans.push_back ({ a, worstIndex });
+                spans.push_back ({ worstIndex, b });
+            }
+        }
+
+        std::vector<Point> kept;
+
+        for (size_t i = 0; i < points.size(); ++i)
+            if (keep[i])
+                kept.push_back (points[i]);
+
+        return kept;
+    }
+
+    // Replaces the curve between the first and last point. Message thread.
+    static void writeToCurve (tracktion_engine::AutomatableParameter& param, const std::vector<Point>& points)
+    {
+        if (points.empty())
+            return;
+
+        auto& curve = param.getCurve();
+        const auto range = param.getValueRange();
+        curve.removePointsInRegion ({ points.front().time, points.back().time });
+
+        for (auto& p : points)
+            curve.addPoint (p.time, range.getStart() + p.value * range.getLength(), 0.0f);
+    }
+
+    static size_t getCurveBytes (tracktion_engine::AutomatableParameter& param)
+    {
+        juce::MemoryOutputStream out;
+        param.getCurve().state.writeToStream (out);
+        return out.getDataSize();
+    }
+
+    // The size of just the curve's points between start and end, as they'd be saved
+    static size_t getCurveBytes (tracktion_engine::AutomatableParameter& param, double start, double end)
+    {
+        auto& curveState = param.getCurve().state;
+        juce::ValueTree points (curveState.getType());
+
+        for (auto child : curveState)
+        {
+            const double time = child[tracktion_engine::IDs::t];
+
+            if (child.hasType (tracktion_engine::IDs::POINT) && time >= start && time <= end)
+                points.appendChild (child.createCopy(), nullptr);
+        }
+
+        juce::MemoryOutputStream out;
+        points.writeToStream (out);
+        return out.getDataSize();
+    }
+
+private:
+    struct Event
+    {
+        tracktion_engine::AutomatableParameter* param = nullptr;
+        double wallMs = 0.0;
+        float value = 0.0f;
+        bool gestureEnd = false;
+    };
+
+    struct Segment
+    {
+        std::vector<std::pair<double, float>> wallPoints;
+        double lastEventMs = 0.0;
+        bool ended = false;
+    };
+
+    struct Thinned
+    {
+        tracktion_engine::AutomatableParameter* param = nullptr;
+        std::vector<Point> points;
+        int rawEvents = 0;
+    };
+
+    static constexpr int timelineHz = 60, queueSize = 65536, pollIntervalMs = 20;
+    static constexpr double segmentIdleMs = 500.0;
+
+    tracktion_engine::Edit& edit;
+    MultiProducerQueue<Event> queue { queueSize };
+    std::atomic<bool> capturing { false }, passEnding { false };
+    std::atomic<float> tolerance { 0.005f };
+
+    // Message thread only. The parameters of the last pass are kept until the next one starts,
+    // as their thinned segments arrive after it has ended.
+    juce::ReferenceCountedArray<tracktion_engine::AutomatableParameter> params;
+    PassStats stats;
+    std::set<tracktion_engine::AutomatableParameter*> touched;
+    bool inPass = false;
+
+    // Transport positions by wall clock time, written on the message thread, read when mapping segments
+    juce::CriticalSection timelineLock;
+    std::vector<std::pair<double, double>> timeline;
+
+    // The thinning thread's own
+    std::map<tracktion_engine::AutomatableParameter*, Segment> segments;
+
+    //==============================================================================
+    void timerCallback() override
+    {
+        auto& transport = edit.getTransport();
+
+        if (transport.isPlaying() && ! inPass)
+            beginPass();
+        else if (! transport.isPlaying() && inPass)
+            endPass();
+
+        if (inPass)
+        {
+            const juce::ScopedLock sl (timelineLock);
+            timeline.push_back ({ juce::Time::getMillisecondCounterHiRes(), transport.getCurrentPosition() });
+        }
+    }
+
+    void beginPass()
+    {
+        inPass = true;
+        stats = {};
+        params.clear();
+        touched.clear();
+
+        {
+            const juce::ScopedLock sl (timelineLock);
+            timeline.clear();
+            timeline.push_back ({ juce::Time::getMillisecondCounterHiRes(), edit.getTransport().getCurrentPosition() });
+        }
+
+        if (auto track = EngineHelpers::getOrInsertAudioTrackAt (edit, 0))
+            for (auto plugin : track->pluginList)
+                for (auto param : plugin->getAutomatableParameters())
+                    params.add (param);
+
+        for (auto param : params)
+            param->addListener (this);
+
+        capturing = true;
+        notify();
+    }
+
+    // The thinning thread flushes what's left and calls finishPass() once the curves are written
+    void endPass()
+    {
+        if (! inPass)
+            return;
+
+        inPass = false;
+        capturing = false;
+        detach();
+
+        {
+            const juce::ScopedLock sl (timelineLock);
+            timeline.push_back ({ juce::Time::getMillisecondCounterHiRes(), edit.getTransport().getCurrentPosition() });
+        }
+
+        stats.seconds = timeline.size() > 1 ? (timeline.back().first - timeline.front().first) / 1000.0 : 0.0;
+        passEnding = true;
+        notify();
+    }
+
+    void detach()
+    {
+        for (auto param : params)
+            param->removeListener (this);
+    }
+
+    void finishPass()
+    {
+        stats.numParameters = (int) touched.size();
+        stats.droppedEvents = queue.getNumDropped();
+
+        if (onPassFinished != nullptr)
+            onPassFinished (stats);
+    }
+
+    // Message thread
+    void applyThinned (std::vector<Thinned>& thinned)
+    {
+        for (auto& t : thinned)
+        {
+            if (! params.contains (t.param))
+                continue;
+
+            writeToCurve (*t.param, t.points);
+            touched.insert (t.param);
+
+            // Only what this pass wrote, not whatever the curve held already
+            if (! t.points.empty())
+                stats.curveBytes += getCurveBytes (*t.param, t.points.front().time, t.points.back().time);
+
+            stats.rawEvents += t.rawEvents;
+            stats.keptPoints += (int) t.points.size();
+        }
+    }
+
+    //==============================================================================
+    // Whichever thread changed the parameter
+    void curveHasChanged (tracktion_engine::AutomatableParameter&) override {}
+
+    void parameterChanged (tracktion_engine::AutomatableParameter& param, float newValue) override
+    {
+        if (! capturing)
+            return;
+
+        const auto range = param.getValueRange();
+        queue.push ({ &param, juce::Time::getMillisecondCounterHiRes(),
+                      range.getLength() > 0.0f ? (newValue - range.getStart()) / range.getLength() : 0.0f, false });
+    }
+
+    void parameterChangeGestureEnd (tracktion_engine::AutomatableParameter& param) override
+    {
+        if (capturing)
+            queue.push ({ &param, juce::Time::getMillisecondCounterHiRes(), 0.0f, true });
+    }
+
+    //==============================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            // Changes can come from the audio thread, which mustn't signal anything, so the queue is
+            // polled during a pass. Between passes nothing can arrive, and beginPass() or endPass()
+            // wakes the thread when there's something to do.
+            wait (capturing || ! segments.empty() ? pollIntervalMs : -1);
+
+            Event e;
+
+            while (queue.pop (e))
+            {
+                auto& segment = segments[e.param];
+
+                if (e.gestureEnd)
+                    segment.ended = true;
+                else
+                    segment.wallPoints.push_back ({ e.wallMs, e.value });
+
+                segment.lastEventMs = e.wallMs;
+            }
+
+            const auto passEnded = passEnding.exchange (false);
+            const auto now = juce::Time::getMillisecondCounterHiRes();
+            std::vector<Thinned> thinned;
+
+            for (auto it = segments.begin(); it != segments.end();)
+            {
+                auto& segment = it->second;
+
+                if (passEnded || segment.ended || now - segment.lastEventMs > segmentIdleMs)
+                {
+                    for (auto& points : toEditTime (segment.wallPoints))
+                        thinned.push_back ({ it->first, thin (points, tolerance), (int) points.size() });
+
+                    it = segments.erase (it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            if (thinned.empty() && ! passEnded)
+                continue;
+
+            juce::MessageManager::callAsync ([ref = juce::WeakReference<AutomationRecorder> (this), thinned = std::move (thinned), passEnded]() mutable
+                                             {
+                                                 if (auto r = ref.get())
+                                                 {
+                                                     r->applyThinned (thinned);
+
+                                                     if (passEnded)
+                                                         r->finishPass();
+                                                 }
+                                             });
+        }
+    }
+
+    // Maps wall clock times to Edit times between the transport positions either side. The
+    // result is split wherever the Edit time goes backwards, i.e. where the transport looped.
+    std::vector<std::vector<Point>> toEditTime (const std::vector<std::pair<double, float>>& wallPoints)
+    {
+        std::vector<std::vector<Point>> runs (1);
+        const juce::ScopedLock sl (timelineLock);
+
+        if (timeline.empty())
+            return {};
+
+        for (auto& [wallMs, value] : wallPoints)
+        {
+            auto next = std::upper_bound (timeline.begin(), timeline.end(), wallMs,
+                                          [] (double t, const std::pair<double, double>& entry) { return t < entry.first; });
+            const auto& before = next == timeline.begin() ? *next : *std::prev (next);
+
+            // Extrapolate from the last position before; interpolating towards the next one would be wrong across a loop
+            const auto time = before.second + juce::jmax (0.0, wallMs - before.first) / 1000.0;
+
+            if (! runs.back().empty() && time < runs.back().back().time)
+                runs.emplace_back();
+
+            runs.back().push_back ({ time, value });
+        }
+
+        return runs;
+    }
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (AutomationRecorder)
+    JUCE_DECLARE_NON_COPYABLE (AutomationRecorder)
+};
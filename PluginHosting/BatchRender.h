@@ -0,0 +1,192 @@
+#pragma once
+
+//==============================================================================
+// Renders a folder of audio files through a saved chain, several files at a time.
+//
+// The chain is track 0's plugins in a session saved by the host. Each worker loads its own Edit
+// from the session, so each has its own plugin instances. A worker takes the next file, makes
+// it track 0's only clip and renders track 0 (without the master plugins) on a pool thread.
+// Edits and RenderTasks are only created and destroyed on the calling thread, which must be the
+// message thread, as OfflineRender requires.
+//
+// Memory is bounded by the number of workers, not files. Each worker holds one Edit and one
+// render at a time, clips stream from disk, and each file's reader is released once it's done.
+//
+// Each output is named after the whole input file name, so "a.wav" and "a.flac" don't write over
+// each other, and an output folder that holds any of the inputs is refused.
+namespace BatchRender
+{
+    struct Progress
+    {
+        int numFiles = 0, filesDone = 0, filesFailed = 0;
+
+        // Failed files are taken out of the total rather than counted as done
+        double totalAudioSeconds = 0.0, audioSecondsDone = 0.0, wallSeconds = 0.0;
+
+        // Audio seconds rendered per wall-clock second
+        double getThroughput() const    { return wallSeconds > 0.0 ? audioSecondsDone / wallSeconds : 0.0; }
+
+        double getEtaSeconds() const
+        {
+            const auto throughput = getThroughput();
+            return throughput > 0.0 ? (totalAudioSeconds - audioSecondsDone) / throughput : 0.0;
+        }
+    };
+
+    juce::Array<juce::File> findAudioFiles (tracktion_engine::Engine& engine, const juce::File& dir)
+    {
+        auto files = dir.findChildFiles (juce::File::findFiles, false,
+                                         engine.getAudioFileFormatManager().readFormatManager.getWildcardForAllFormats());
+        files.sort();
+        return files;
+    }
+
+    struct Worker
+    {
+        std::unique_ptr<tracktion_engine::Edit> edit;
+        std::unique_ptr<tracktion_engine::Renderer::RenderTask> task;
+        std::atomic<float> progress { 0.0f };
+        std::atomic<bool> finished { false };
+        juce::File input;
+        double audioSeconds = 0.0;
+    };
+
+    // Loads the file onto the worker's track 0 and prepares its render
+    bool prepare (Worker& w, const juce::File& input, const juce::File& outputDir, int blockSize)
+    {
+        auto& engine = w.edit->engine;
+        auto track = EngineHelpers::getOrInsertAudioTrackAt (*w.edit, 0);
+        EngineHelpers::removeAllClips (*track);
+
+        if (EngineHelpers::loadAudioFileAsClip (*track, input) == nullptr)
+            return false;
+
+        juce::BigInteger tracksToDo;
+        tracksToDo.setBit (tracktion_engine::getAllTracks (*w.edit).indexOf (track));
+
+        auto output = outputDir.getChildFile (input.getFileName() + ".wav");
+        output.deleteFile();
+
+        auto params = OfflineRender::createParameters (*w.edit, output, tracksToDo,
+                                                       tracktion_engine::AudioFile (engine, input).getSampleRate(), blockSize);
+        params.useMasterPlugins = false;
+
+        w.input = input;
+        w.audioSeconds = params.time.getLength();
+        w.finished = false;
+        w.progress = 0.0f;
+        w.task = std::make_unique<tracktion_engine::Renderer::RenderTask> ("Batch", params, &w.progress, nullptr);
+        return true;
+    }
+
+    // onProgress is called on this thread whenever a file finishes, and at least every
+    // progressIntervalMs. If the chain can't be loaded, error is set and nothing is rendered.
+    Progress run (tracktion_engine::Engine& engine, const juce::File& chainFile, const juce::Array<juce::File>& files,
+                  const juce::File& outputDir, int numWorkers, int blockSize,
+                  const std::function<void (const Progress&)>& onProgress, juce::String& error,
+                  int progressIntervalMs = 1000)
+    {
+        Progress progress;
+        progress.numFiles = files.size();
+
+        for (auto& f : files)
+        {
+            if (f.getParentDirectory() == outputDir)
+            {
+                error = "The output folder can't be the one the inputs are in";
+                return progress;
+            }
+        }
+
+        // Only reads the headers
+        for (auto& f : files)
+            progress.totalAudioSeconds += tracktion_engine::AudioFile (engine, f).getLength();
+
+        outputDir.createDirectory();
+        numWorkers = juce::jlimit (1, juce::jmax (1, files.size()), numWorkers);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        for (int i = 0; i < numWorkers; ++i)
+        {
+            auto w = std::make_unique<Worker>();
+            w->edit = BinarySession::load (engine, chainFile, error);
+
+            if (w->edit == nullptr)
+                return progress;
+
+            for (auto t : tracktion_engine::getAudioTracks (*w->edit))
+                EngineHelpers::removeAllClips (*t);
+
+            workers.push_back (std::move (w));
+        }
+
+        juce::ThreadPool pool (numWorkers);
+        juce::WaitableEvent anyFinished;
+        int nextFile = 0;
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+
+        auto isBusy = [&]
+        {
+            for (auto& w : workers)
+                if (w->task != nullptr)
+                    return true;
+
+            return false;
+        };
+
+        while (nextFile < files.size() || isBusy())
+        {
+            for (auto& w : workers)
+            {
+                if (w->task != nullptr && w->finished)
+                {
+                    if (w->task->errorMessage.isNotEmpty())
+                    {
+                        ++progress.filesFailed;
+                        progress.totalAudioSeconds -= tracktion_engine::AudioFile (engine, w->input).getLength();
+                    }
+                    else
+                    {
+                        progress.audioSecondsDone += w->audioSeconds;
+                    }
+
+                    w->task.reset();
+                    engine.getAudioFileManager().releaseFile (tracktion_engine::AudioFile (engine, w->input));
+                    ++progress.filesDone;
+                }
+
+                while (w->task == nullptr && nextFile < files.size())
+                {
+                    const auto& input = files.getReference (nextFile++);
+
+                    if (prepare (*w, input, outputDir, blockSize))
+                    {
+                        pool.addJob ([worker = w.get(), &anyFinished]
+                                     {
+                                         while (worker->task->runJob() == juce::ThreadPoolJob::jobNeedsRunningAgain)
+                                         {}
+
+                                         worker->finished = true;
+                                         anyFinished.signal();
+                                     });
+                    }
+                    else
+                    {
+                        ++progress.filesDone;
+                        ++progress.filesFailed;
+                        progress.totalAudioSeconds -= tracktion_engine::AudioFile (engine, input).getLength();
+                    }
+                }
+            }
+
+            anyFinished.wait (progressIntervalMs);
+            progress.wallSeconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+
+            if (onProgress != nullptr)
+                onProgress (progress);
+        }
+
+        return progress;
+    }
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+//==============================================================================
+// A compact binary file format for Edits.
+//
+// The Edit's ValueTree is written with ValueTree::writeToStream, which is much quicker to read
+// back than XML. Large plugin states are taken out of the tree first and stored as raw bytes
+// rather than base64. Each one goes in its own 16-byte-aligned block, and the tree records which
+// block each came from. Loading memory-maps the file, so only the tree is parsed, and each state
+// is copied straight from the mapping into a binary var. That's the form tracktion's plugins
+// read back: a binary var's toString() is its base64 encoding.
+//
+// Layout:   header | state blobs | tree | blob table (offset, size per blob)
+namespace BinarySession
+{
+    static constexpr int magic = 0x42534554; // "TESB"
+    static constexpr int formatVersion = 1;
+    static constexpr int headerSize = 4 + 4 + 4 + 8 + 8 + 8;
+    static constexpr int blobAlignment = 16;
+    static constexpr int minBlobChars = 256;
+    static constexpr const char* blobPropertyPrefix = "blob_";
+    static constexpr const char* fileExtension = ".tesb";
+
+    // True for a binary property, or a plugin state stored as base64 long enough to be worth
+    // storing separately, in which case raw is set to its bytes
+    bool getBlobData (const juce::Identifier& name, const juce::var& value, juce::MemoryBlock& raw)
+    {
+        if (auto binary = value.getBinaryData())
+        {
+            raw = *binary;
+            return true;
+        }
+
+        return name == tracktion_engine::IDs::state && value.isString()
+                 && value.toString().length() >= minBlobChars && raw.fromBase64Encoding (value.toString());
+    }
+
+    // Replaces large binary or base64 state properties with the index of a blob
+    void extractBlobs (juce::ValueTree& v, std::vector<juce::MemoryBlock>& blobs)
+    {
+        for (int i = v.getNumProperties(); --i >= 0;)
+        {
+            const auto name = v.getPropertyName (i);
+            juce::MemoryBlock raw;
+
+            if (! getBlobData (name, v[name], raw))
+                continue;
+
+            v.setProperty (blobPropertyPrefix + name.toString(), (int) blobs.size(), nullptr);
+            v.removeProperty (name, nullptr);
+            blobs.push_back (std::move (raw));
+        }
+
+        for (auto child : v)
+            extractBlobs (child, blobs);
+    }
+
+    bool restoreBlobs (juce::ValueTree& v, const char* fileData, const std::vector<juce::Range<juce::int64>>& blobs)
+    {
+        for (int i = v.getNumProperties(); --i >= 0;)
+        {
+            const auto name = v.getPropertyName (i).toString();
+
+            if (! name.startsWith (blobPropertyPrefix))
+                continue;
+
+            const auto index = (int) v[name];
+
+            if (! juce::isPositiveAndBelow (index, (int) blobs.size()))
+                return false;
+
+            const auto& blob = blobs[(size_t) index];
+            v.setProperty (name.substring ((int) strlen (blobPropertyPrefix)),
+                           juce::var (fileData + blob.getStart(), (size_t) blob.getLength()), nullptr);
+            v.removeProperty (name, nullptr);
+        }
+
+        for (auto child : v)
+            if (! restoreBlobs (child, fileData, blobs))
+                return false;
+
+        return true;
+    }
+
+    //==============================================================================
+    bool writeTree (const juce::ValueTree& state, const juce::File& file)
+    {
+        auto tree = state.createCopy();
+        std::vector<juce::MemoryBlock> blobs;
+        extractBlobs (tree, blobs);
+
+        juce::TemporaryFile temp (file);
+
+        {
+            auto out = temp.getFile().createOutputStream();
+
+            if (out == nullptr)
+                return false;
+
+            // The header is filled in once the offsets are known
+            out->writeRepeatedByte (0, headerSize);
+
+            std::vector<juce::Range<juce::int64>> table;
+
+            for (auto& blob : blobs)
+            {
+                const auto padding = (int) ((blobAlignment - out->getPosition() % blobAlignment) % blobAlignment);
+                out->writeRepeatedByte (0, (size_t) padding);
+                table.push_back (juce::Range<juce::int64>::withStartAndLength (out->getPosition(), (juce::int64) blob.getSize()));
+                out->write (blob.getData(), blob.getSize());
+            }
+
+            const auto treeOffset = out->getPosition();
+            tree.writeToStream (*out);
+            const auto tableOffset = out->getPosition();
+
+            for (auto& r : table)
+            {
+                out->writeInt64 (r.getStart());
+                out->writeInt64 (r.getLength());
+            }
+
+            out->setPosition (0);
+            out->writeInt (magic);
+            out->writeInt (formatVersion);
+            out->writeInt ((int) table.size());
+            out->writeInt64 (treeOffset);
+            out->writeInt64 (tableOffset - treeOffset);
+            out->writeInt64 (tableOffset);
+            out->flush();
+
+            if (! out->getStatus().wasOk())
+                return false;
+        }
+
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+    // Returns an invalid tree if the file can't be read
+    juce::ValueTree readTree (const juce::File& file, juce::String& error)
+    {
+        juce::MemoryMappedFile mapped (file, juce::MemoryMappedFile::readOnly);
+        auto data = static_cast<const char*> (mapped.getData());
+        const auto fileSize = (juce::int64) mapped.getSize();
+
+        if (data == nullptr || fileSize < headerSize)
+        {
+            error = "Couldn't open " + file.getFullPathName();
+            return {};
+        }
+
+        juce::MemoryInputStream header (data, headerSize, false);
+        const auto fileMagic    = header.readInt();
+        const auto version      = header.readInt();
+        const auto numBlobs     = header.readInt();
+        const auto treeOffset   = header.readInt64();
+        const auto treeSize     = header.readInt64();
+        const auto tableOffset  = header.readInt64();
+
+        // Compared as differences from the file size, so a damaged header can't overflow them. The
+        // table has to come after the tree, which comes after the header.
+        if (fileMagic != magic || version != formatVersion || numBlobs < 0
+             || treeOffset < headerSize || treeOffset > fileSize
+             || treeSize < 0 || treeSize > fileSize - treeOffset
+             || tableOffset < treeOffset + treeSize || tableOffset > fileSize
+             || (juce::int64) numBlobs * 16 > fileSize - tableOffset)
+        {
+            error = file.getFileName() + " isn't a session file, or is damaged";
+            return {};
+        }
+
+        std::vector<juce::Range<juce::int64>> blobs;
+        juce::MemoryInputStream table (data + tableOffset, (size_t) numBlobs * 16, false);
+
+        for (int i = 0; i < numBlobs; ++i)
+        {
+            const auto start = table.readInt64();
+            const auto length = table.readInt64();
+
+            if (start < headerSize || start > treeOffset || length < 0 || length > treeOffset - start)
+            {
+                error = file.getFileName() + " is damaged";
+                return {};
+            }
+
+            blobs.push_back (juce::Range<juce::int64>::withStartAndLength (start, length));
+        }
+
+        auto tree = juce::ValueTree::readFromData (data + treeOffset, (size_t) treeSize);
+
+        if (! tree.isValid() || ! restoreBlobs (tree, data, blobs))
+        {
+            error = file.getFileName() + " is damaged";
+            return {};
+        }
+
+        return tree;
+    }
+
+    //==============================================================================
+    // adjustTree can change the copy of the Edit's state that gets written
+    bool save (tracktion_engine::Edit& edit, const juce::File& file, std::function<void (juce::ValueTree&)> adjustTree = {})
+    {
+        edit.flushState();
+        auto tree = edit.state.createCopy();
+
+        if (adjustTree != nullptr)
+            adjustTree (tree);
+
+        return writeTree (tree, file);
+    }
+
+    std::unique_ptr<tracktion_engine::Edit> load (tracktion_engine::Engine& engine, const juce::File& file, juce::String& error)
+    {
+        auto tree = readTree (file, error);
+
+        if (! tree.isValid())
+            return {};
+
+        return std::make_unique<tracktion_engine::Edit> (tracktion_engine::Edit::Options { engine, tree,
+                                                                                         tracktion_engine::ProjectItemID::createNewID (0) });
+    }
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+//==============================================================================
+// Times every block of the engine's audio device callback against its deadline.
+//
+// The monitor adds two callbacks of its own to the AudioDeviceManager, one either side of the
+// engine's, rather than taking the engine's callback over. The manager calls its first callback
+// with the device's buffers and then the rest in reverse order, so with the list in the order
+// [monitor, end probe, engine] each block runs monitor (start), engine, end probe (finish). The
+// engine appends itself whenever it re-registers, so it always stays between the two, and nothing
+// ever calls it but the device manager. That's why the monitor has to be created before the
+// engine's DeviceManager is initialised.
+//
+// Every callback after the first writes into one scratch buffer that the manager adds to the
+// device's output after each call, without clearing it in between. So the end probe clears the
+// buffer it's given, which still holds the engine's block, or the block would be added twice.
+//
+// The audio thread only ever does relaxed increments on atomics that it alone writes, so
+// nothing here can block it. Readers (the overlay, JSON dumps) build a Snapshot from the
+// counters on the message thread; a snapshot taken mid-callback may be off by one block,
+// which doesn't matter for a histogram.
+class CallbackHealthMonitor : private juce::AudioIODeviceCallback
+{
+public:
+    // Load is measured as callback duration / buffer duration, in bins of 0.5% up to 200%.
+    // Jitter is |start-to-start interval - buffer duration|, in bins of 50us up to 20ms.
+    static constexpr int numLoadBins     = 400;
+    static constexpr double loadBinWidth = 0.005;
+    static constexpr int numJitterBins   = 400;
+    static constexpr double jitterBinMs  = 0.05;
+
+    CallbackHealthMonitor (tracktion_engine::Engine& e)
+        : deviceManager (e.getDeviceManager().deviceManager)
+    {
+        deviceManager.addAudioCallback (this);
+        deviceManager.addAudioCallback (&endProbe);
+    }
+
+    ~CallbackHealthMonitor() override
+    {
+        deviceManager.removeAudioCallback (&endProbe);
+        deviceManager.removeAudioCallback (this);
+    }
+
+    //==============================================================================
+    struct Snapshot
+    {
+        juce::uint64 numCallbacks = 0, numOverruns = 0;
+        int deviceXruns = 0;
+        double sampleRate = 0.0;
+        int bufferSize = 0;
+        double meanLoad = 0.0, maxLoad = 0.0, p99Load = 0.0, p999Load = 0.0;
+        double p99JitterMs = 0.0, maxJitterMs = 0.0;
+        std::array<juce::uint32, numLoadBins> loadHistogram {};
+        std::array<juce::uint32, numJitterBins> jitterHistogram {};
+
+        double getBufferMs() const      { return sampleRate > 0.0 ? 1000.0 * bufferSize / sampleRate : 0.0; }
+    };
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot s;
+        s.numCallbacks  = numCallbacks.load (std::memory_order_relaxed);
+        s.numOverruns   = numOverruns.load (std::memory_order_relaxed);
+        s.deviceXruns   = juce::jmax (0, deviceManager.getXRunCount());
+        s.sampleRate    = sampleRate.load (std::memory_order_relaxed);
+        s.bufferSize    = bufferSize.load (std::memory_order_relaxed);
+        s.maxLoad       = maxLoad.load (std::memory_order_relaxed);
+        s.maxJitterMs   = maxJitterMs.load (std::memory_order_relaxed);
+
+        for (int i = 0; i < numLoadBins; ++i)
+            s.loadHistogram[(size_t) i] = loadBins[(size_t) i].load (std::memory_order_relaxed);
+
+        for (int i = 0; i < numJitterBins; ++i)
+            s.jitterHistogram[(size_t) i] = jitterBins[(size_t) i].load (std::memory_order_relaxed);
+
+        s.p99Load     = getPercentile (s.loadHistogram, 0.99) * loadBinWidth;
+        s.p999Load    = getPercentile (s.loadHistogram, 0.999) * loadBinWidth;
+        s.p99JitterMs = getPercentile (s.jitterHistogram, 0.99) * jitterBinMs;
+
+        if (s.numCallbacks > 0)
+            s.meanLoad = (double) loadSumMicro.load (std::memory_order_relaxed) / 1.0e6 / (double) s.numCallbacks;
+
+        return s;
+    }
+
+    juce::var toJSON() const
+    {
+        auto s = getSnapshot();
+        auto obj = new juce::DynamicObject();
+
+        obj->setProperty ("device",         deviceManager.getCurrentAudioDevice() != nullptr
+                                                ? deviceManager.getCurrentAudioDevice()->getName() : juce::String());
+        obj->setProperty ("sampleRate",     s.sampleRate);
+        obj->setProperty ("bufferSize",     s.bufferSize);
+        obj->setProperty ("bufferMs",       s.getBufferMs());
+        obj->setProperty ("callbacks",      (juce::int64) s.numCallbacks);
+        obj->setProperty ("overruns",       (juce::int64) s.numOverruns);
+        obj->setProperty ("deviceXruns",    s.deviceXruns);
+        obj->setProperty ("meanLoad",       s.meanLoad);
+        obj->setProperty ("maxLoad",        s.maxLoad);
+        obj->setProperty ("p99Load",        s.p99Load);
+        obj->setProperty ("p999Load",       s.p999Load);
+        obj->setProperty ("p99JitterMs",    s.p99JitterMs);
+        obj->setProperty ("maxJitterMs",    s.maxJitterMs);
+        obj->setProperty ("loadBinWidth",   loadBinWidth);
+        obj->setProperty ("loadHistogram",  toVar (s.loadHistogram));
+        obj->setProperty ("jitterBinMs",    jitterBinMs);
+        obj->setProperty ("jitterHistogram", toVar (s.jitterHistogram));
+
+        return juce::var (obj);
+    }
+
+    bool writeJSON (const juce::File& file) const
+    {
+        return file.replaceWithText (juce::JSON::toString (toJSON()));
+    }
+
+    // Counters are cleared by the audio thread at the start of its next callback
+    void reset()    { resetPending.store (true); }
+
+private:
+    // Runs after the engine in each block. What it outputs is added to the device's output, so
+    // it leaves silence rather than the engine's block it was handed.
+    struct EndProbe : public juce::AudioIODeviceCallback
+    {
+        EndProbe (CallbackHealthMonitor& m) : monitor (m) {}
+
+        void audioDeviceIOCallback (const float**, int, float** outputChannelData, int numOutputChannels, int numSamples) override
+        {
+            for (int ch = 0; ch < numOutputChannels; ++ch)
+                if (outputChannelData[ch] != nullptr)
+                    juce::FloatVectorOperations::clear (outputChannelData[ch], numSamples);
+
+            monitor.blockFinished (numSamples);
+        }
+
+        void audioDeviceAboutToStart (juce::AudioIODevice*) override {}
+        void audioDeviceStopped() override {}
+
+        CallbackHealthMonitor& monitor;
+    };
+
+    juce::AudioDeviceManager& deviceManager;
+    EndProbe endProbe { *this };
+
+    std::atomic<double> sampleRate { 0.0 };
+    std::atomic<int> bufferSize { 0 };
+    std::atomic<bool> resetPending { false };
+    juce::int64 startTicks = 0, lastStartTicks = 0; // audio thread only
+
+    std::atomic<juce::uint64> numCallbacks { 0 }, numOverruns { 0 }, loadSumMicro { 0 };
+    std::atomic<double> maxLoad { 0.0 }, maxJitterMs { 0.0 };
+    std::array<std::atomic<juce::uint32>, numLoadBins> loadBins {};
+    std::array<std::atomic<juce::uint32>, numJitterBins> jitterBins {};
+
+    //==============================================================================
+    // As the first callback this gets the device's own output buffers, which the engine's
+    // output is then added to, so it has to clear them
+    void audioDeviceIOCallback (const float**, int, float** outputChannelData, int numOutputChannels, int numSamples) override
+    {
+        startTicks = juce::Time::getHighResolutionTicks();
+
+        if (resetPending.exchange (false))
+            clearCounters();
+
+        for (int ch = 0; ch < numOutputChannels; ++ch)
+            if (outputChannelData[ch] != nullptr)
+                juce::FloatVectorOperations::clear (outputChannelData[ch], numSamples);
+    }
+
+    void blockFinished (int numSamples) noexcept
+    {
+        const auto endTicks = juce::Time::getHighResolutionTicks();
+        const auto rate = sampleRate.load (std::memory_order_relaxed);
+
+        if (rate <= 0.0 || numSamples <= 0)
+            return;
+
+        const auto deadlineSeconds = numSamples / rate;
+        const auto load = juce::Time::highResolutionTicksToSeconds (endTicks - startTicks) / deadlineSeconds;
+
+        increment (loadBins[(size_t) juce::jlimit (0, numLoadBins - 1, (int) (load / loadBinWidth))]);
+        increment (numCallbacks);
+        loadSumMicro.store (loadSumMicro.load (std::memory_order_relaxed) + (juce::uint64) (load * 1.0e6), std::memory_order_relaxed);
+
+        if (load > 1.0)
+            increment (numOverruns);
+
+        if (load > maxLoad.load (std::memory_order_relaxed))
+            maxLoad.store (load, std::memory_order_relaxed);
+
+        if (lastStartTicks != 0)
+        {
+            const auto intervalSeconds = juce::Time::highResolutionTicksToSeconds (startTicks - lastStartTicks);
+            const auto jitterMs = std::abs (intervalSeconds - deadlineSeconds) * 1000.0;
+
+            increment (jitterBins[(size_t) juce::jlimit (0, numJitterBins - 1, (int) (jitterMs / jitterBinMs))]);
+
+            if (jitterMs > maxJitterMs.load (std::memory_order_relaxed))
+                maxJitterMs.store (jitterMs, std::memory_order_relaxed);
+        }
+
+        lastStartTicks = startTicks;
+    }
+
+    void audioDeviceAboutToStart (juce::AudioIODevice* device) override
+    {
+        sampleRate.store (device->getCurrentSampleRate());
+        bufferSize.store (device->getCurrentBufferSizeSamples());
+        lastStartTicks = 0;
+        resetPending.store (true);
+    }
+
+    void audioDeviceStopped() override {}
+
+    template<typename AtomicType>
+    static void increment (AtomicType& a) noexcept
+    {
+        // Single writer, so a load/store pair avoids a locked read-modify-write on the audio thread
+        a.store (a.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void clearCounters() noexcept
+    {
+        numCallbacks.store (0, std::memory_order_relaxed);
+        numOverruns.store (0, std::memory_order_relaxed);
+        loadSumMicro.store (0, std::memory_order_relaxed);
+        maxLoad.store (0.0, std::memory_order_relaxed);
+        maxJitterMs.store (0.0, std::memory_order_relaxed);
+
+        for (auto& b : loadBins)    b.store (0, std::memory_order_relaxed);
+        for (auto& b : jitterBins)  b.store (0, std::memory_order_relaxed);
+    }
+
+    // Returns the upper edge of the bin containing the given proportion of samples, in bins
+    template<size_t N>
+    static double getPercentile (const std::array<juce::uint32, N>& bins, double proportion)
+    {
+        juce::uint64 total = 0;
+
+        for (auto b : bins)
+            total += b;
+
+        if (total == 0)
+            return 0.0;
+
+        const auto target = (juce::uint64) std::ceil (proportion * (double) total);
+        juce::uint64 running = 0;
+
+        for (size_t i = 0; i < N; ++i)
+        {
+            running += bins[i];
+
+            if (running >= target)
+                return (double) (i + 1);
+        }
+
+        return (double) N;
+    }
+
+    template<size_t N>
+    static juce::var toVar (const std::array<juce::uint32, N>& bins)
+    {
+        juce::Array<juce::var> values;
+
+        for (auto b : bins)
+            values.add ((juce::int64) b);
+
+        return values;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CallbackHealthMonitor)
+};
+
+//==============================================================================
+// Overlay drawn over MainComponent showing the monitor's current state
+class CallbackHealthComponent : public juce::Component,
+                                private juce::Timer
+{
+public:
+    CallbackHealthComponent (CallbackHealthMonitor& m) : monitor (m)
+    {
+        setInterceptsMouseClicks (false, false);
+        startTimerHz (10);
+    }
+
+    void paint (juce::Graphics& g) override
+    {
+        auto b = getLocalBounds().toFloat();
+        g.setColour (juce::Colours::black.withAlpha (0.6f));
+        g.fillRoundedRectangle (b, 4.0f);
+
+        auto textArea = getLocalBounds().reduced (6);
+        auto line = [&] (const juce::String& text, juce::Colour c = juce::Colours::white)
+        {
+            g.setColour (c);
+            g.drawText (text, textArea.removeFromTop (14), juce::Justification::centredLeft);
+        };
+
+        g.setFont (12.0f);
+        line ("Buffer: " + juce::String (snapshot.bufferSize) + " @ " + juce::String (snapshot.sampleRate, 0)
+                + " Hz (" + juce::String (snapshot.getBufferMs(), 2) + " ms)");
+        line ("Callbacks: " + juce::String ((juce::int64) snapshot.numCallbacks));
+        line ("Xruns: " + juce::String ((juce::int64) snapshot.numOverruns) + " late, "
+                + juce::String (snapshot.deviceXruns) + " device",
+              snapshot.numOverruns > 0 || snapshot.deviceXruns > 0 ? juce::Colours::red : juce::Colours::white);
+        line ("Load mean/p99/p99.9/max: " + percent (snapshot.meanLoad) + " / " + percent (snapshot.p99Load)
+                + " / " + percent (snapshot.p999Load) + " / " + percent (snapshot.maxLoad),
+              snapshot.p999Load > 0.8 ? juce::Colours::orange : juce::Colours::white);
+        line ("Jitter p99/max: " + juce::String (snapshot.p99JitterMs, 2) + " / " + juce::String (snapshot.maxJitterMs, 2) + " ms");
+
+        drawLoadHistogram (g, textArea.reduced (0, 4).toFloat());
+    }
+
+private:
+    CallbackHealthMonitor& monitor;
+    CallbackHealthMonitor::Snapshot snapshot;
+
+    static juce::String percent (double v)     { return juce::String (v * 100.0, 1) + "%"; }
+
+    void drawLoadHistogram (juce::Graphics& g, juce::Rectangle<float> area)
+    {
+        // Bins are combined in pairs so each bar is 1% of the deadline; the red line is 100%
+        constexpr int binsPerBar = 2;
+        constexpr int numBars = CallbackHealthMonitor::numLoadBins / binsPerBar;
+
+        juce::uint32 peak = 1;
+        std::array<juce::uint32, numBars> bars {};
+
+        for (int i = 0; i < CallbackHealthMonitor::numLoadBins; ++i)
+            bars[(size_t) (i / binsPerBar)] += snapshot.loadHistogram[(size_t) i];
+
+        for (auto b : bars)
+            peak = juce::jmax (peak, b);
+
+        const auto barWidth = area.getWidth() / numBars;
+        g.setColour (juce::Colours::lightgreen);
+
+        for (int i = 0; i < numBars; ++i)
+        {
+            // Log scale, otherwise the rare slow callbacks we care about are invisible
+            auto h = area.getHeight() * (float) (std::log1p ((double) bars[(size_t) i]) / std::log1p ((double) peak));
+            g.fillRect (area.getX() + i * barWidth, area.getBottom() - h, juce::jmax (1.0f, barWidth), h);
+        }
+
+        g.setColour (juce::Colours::red);
+        const auto deadlineX = area.getX() + area.getWidth() * 0.5f;
+        g.drawVerticalLine ((int) deadlineX, area.getY(), area.getBottom());
+    }
+
+    void timerCallback() override
+    {
+        snapshot = monitor.getSnapshot();
+        repaint();
+    }
+};
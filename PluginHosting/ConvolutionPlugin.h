@@ -0,0 +1,379 @@
+#pragma once
+
+//==============================================================================
+// Zero-latency convolution of one channel with an impulse response.
+//
+// The first partitionSize taps (the head) are applied directly in the time domain, so the
+// output never waits for a block to fill. The rest (the tail) is split into partitionSize
+// pieces, each transformed once up front. Whenever partitionSize input samples have arrived,
+// they're transformed (overlap-save, FFT size 2 * partitionSize) and added to a frequency-domain
+// delay line, and the spectra are multiplied and summed with the tail partitions. The result is
+// exactly the tail's output for the next partitionSize samples, so the head and tail together
+// have no latency whatever the host's block size.
+//
+// Only the first partition needs the spectrum that has just arrived; every later one meets an
+// input spectrum that was already known during the period before. So those products are summed
+// a few partitions at a time as the samples of the period come in, in step with how many have
+// arrived, and the end of a period only has the two FFTs and the first partition left to do.
+// A long response then costs about the same in every callback, rather than all of it landing
+// in whichever callback completes a period.
+//
+// Spectra are kept as separate real and imaginary arrays, so the complex multiply-accumulate
+// is four FloatVectorOperations::addWithMultiply calls per partition, which JUCE vectorises.
+// The imaginary parts of the partitions are stored negated so none of them is a subtraction.
+class PartitionedConvolver
+{
+public:
+    PartitionedConvolver (const float* ir, int irLength, int partitionSize = 128, int maxBlockSize = 4096)
+        : P (juce::nextPowerOfTwo (juce::jmax (16, partitionSize))),
+          numBins (P + 1),
+          maxBlock (juce::jmax (1, maxBlockSize)),
+          fft (juce::roundToInt (std::log2 (2 * P)))
+    {
+        irLength = juce::jmax (0, irLength);
+        head.assign ((size_t) P, 0.0f);
+
+        for (int i = 0; i < juce::jmin (P, irLength); ++i)
+            head[(size_t) i] = ir[i];
+
+        numPartitions = juce::jmax (0, (irLength - P + P - 1) / P);
+        irRe.assign ((size_t) (numPartitions * numBins), 0.0f);
+        irIm.assign ((size_t) (numPartitions * numBins), 0.0f);
+        irImNeg.assign ((size_t) (numPartitions * numBins), 0.0f);
+        fftBuffer.assign ((size_t) (4 * P), 0.0f);
+
+        for (int k = 0; k < numPartitions; ++k)
+        {
+            std::fill (fftBuffer.begin(), fftBuffer.end(), 0.0f);
+            const auto start = P + k * P;
+
+            for (int i = 0; i < juce::jmin (P, irLength - start); ++i)
+                fftBuffer[(size_t) i] = ir[start + i];
+
+            fft.performRealOnlyForwardTransform (fftBuffer.data(), true);
+
+            for (int b = 0; b < numBins; ++b)
+            {
+                const auto index = (size_t) (k * numBins + b);
+                irRe[index]    = fftBuffer[(size_t) (2 * b)];
+                irIm[index]    = fftBuffer[(size_t) (2 * b + 1)];
+                irImNeg[index] = -irIm[index];
+            }
+        }
+
+        fdlRe.assign (irRe.size(), 0.0f);
+        fdlIm.assign (irIm.size(), 0.0f);
+        accRe.assign ((size_t) numBins, 0.0f);
+        accIm.assign ((size_t) numBins, 0.0f);
+        window.assign ((size_t) (2 * P), 0.0f);
+        tailOut.assign ((size_t) P, 0.0f);
+        headInput.assign ((size_t) (P + maxBlock), 0.0f);
+        headOut.assign ((size_t) maxBlock, 0.0f);
+    }
+
+    int getPartitionSize() const        { return P; }
+    int getNumPartitions() const        { return numPartitions; }
+
+    void reset()
+    {
+        std::fill (fdlRe.begin(), fdlRe.end(), 0.0f);
+        std::fill (fdlIm.begin(), fdlIm.end(), 0.0f);
+        std::fill (window.begin(), window.end(), 0.0f);
+        std::fill (tailOut.begin(), tailOut.end(), 0.0f);
+        std::fill (headInput.begin(), headInput.end(), 0.0f);
+        std::fill (accRe.begin(), accRe.end(), 0.0f);
+        std::fill (accIm.begin(), accIm.end(), 0.0f);
+        fdlPos = 0;
+        pos = 0;
+        nextPartition = 1;
+    }
+
+    // out may be the same as in. Doesn't allocate.
+    void process (const float* in, float* out, int numSamples)
+    {
+        for (int done = 0; done < numSamples;)
+        {
+            const auto num = juce::jmin (numSamples - done, maxBlock);
+            processBlock (in + done, out + done, num);
+            done += num;
+        }
+    }
+
+private:
+    const int P, numBins, maxBlock;
+    juce::dsp::FFT fft;
+    int numPartitions = 0;
+
+    std::vector<float> head;                        // the first P taps
+    std::vector<float> irRe, irIm, irImNeg;         // tail partition spectra, numBins each
+    std::vector<float> fdlRe, fdlIm;                // input spectra, one per partition, as a ring
+    std::vector<float> accRe, accIm, fftBuffer;
+    std::vector<float> window;                      // the last 2P input samples
+    std::vector<float> tailOut;                     // the tail's output for the current P samples
+    std::vector<float> headInput, headOut;          // P samples of history, then the block
+    int fdlPos = 0, pos = 0;
+    int nextPartition = 1;                          // the next one to add into acc for the coming period
+
+    void processBlock (const float* in, float* out, int num)
+    {
+        // Head: one vector multiply-add per tap over the whole block
+        std::copy (in, in + num, headInput.begin() + P);
+        juce::FloatVectorOperations::clear (headOut.data(), num);
+
+        for (int m = 0; m < P; ++m)
+            if (head[(size_t) m] != 0.0f)
+                juce::FloatVectorOperations::addWithMultiply (headOut.data(), headInput.data() + P - m, head[(size_t) m], num);
+
+        // The last P samples become the history for the next block
+        std::copy (headInput.begin() + num, headInput.begin() + num + P, headInput.begin());
+
+        // Tail, a period of P samples at a time
+        for (int done = 0; done < num;)
+        {
+            const auto chunk = juce::jmin (num - done, P - pos);
+
+            std::copy (in + done, in + done + chunk, window.begin() + P + pos);
+            juce::FloatVectorOperations::add (headOut.data() + done, tailOut.data() + pos, chunk);
+
+            pos += chunk;
+            done += chunk;
+
+            // Keep the later partitions in step with the period, so all of them are in by its end
+            accumulatePartitions (1 + (numPartitions - 1) * pos / P);
+
+            if (pos == P)
+                computeTail();
+        }
+
+        std::copy (headOut.begin(), headOut.begin() + num, out);
+    }
+
+    void computeTail()
+    {
+        pos = 0;
+
+        if (numPartitions == 0)
+        {
+            std::copy (window.begin() + P, window.end(), window.begin());
+            return;
+        }
+
+        std::copy (window.begin(), window.end(), fftBuffer.begin());
+        std::fill (fftBuffer.begin() + 2 * P, fftBuffer.end(), 0.0f);
+        fft.performRealOnlyForwardTransform (fftBuffer.data(), true);
+
+        auto* xRe = fdlRe.data() + fdlPos * numBins;
+        auto* xIm = fdlIm.data() + fdlPos * numBins;
+
+        for (int b = 0; b < numBins; ++b)
+        {
+            xRe[b] = fftBuffer[(size_t) (2 * b)];
+            xIm[b] = fftBuffer[(size_t) (2 * b + 1)];
+        }
+
+        // The later partitions were added during the period; only the newest spectrum is left
+        multiplyAccumulate (0);
+        std::fill (fftBuffer.begin(), fftBuffer.end(), 0.0f);
+
+        for (int b = 0; b < numBins; ++b)
+        {
+            fftBuffer[(size_t) (2 * b)]     = accRe[(size_t) b];
+            fftBuffer[(size_t) (2 * b + 1)] = accIm[(size_t) b];
+        }
+
+        fft.performRealOnlyInverseTransform (fftBuffer.data());
+
+        // Overlap-save: only the second half is free of wrap-around
+        std::copy (fftBuffer.begin() + P, fftBuffer.begin() + 2 * P, tailOut.begin());
+        std::copy (window.begin() + P, window.end(), window.begin());
+        fdlPos = (fdlPos + 1) % numPartitions;
+
+        juce::FloatVectorOperations::clear (accRe.data(), numBins);
+        juce::FloatVectorOperations::clear (accIm.data(), numBins);
+        nextPartition = 1;
+    }
+
+    void accumulatePartitions (int upTo)
+    {
+        for (upTo = juce::jmin (upTo, numPartitions); nextPartition < upTo; ++nextPartition)
+            multiplyAccumulate (nextPartition);
+    }
+
+    // Partition k meets the spectrum of the input from k periods before the one now arriving,
+    // which goes into slot fdlPos
+    void multiplyAccumulate (int k)
+    {
+        const auto slot = (fdlPos - k + numPartitions) % numPartitions;
+        const auto* re = fdlRe.data() + slot * numBins;
+        const auto* im = fdlIm.data() + slot * numBins;
+        const auto* hRe = irRe.data() + k * numBins;
+        const auto* hIm = irIm.data() + k * numBins;
+        const auto* hImNeg = irImNeg.data() + k * numBins;
+
+        juce::FloatVectorOperations::addWithMultiply (accRe.data(), re, hRe, numBins);
+        juce::FloatVectorOperations::addWithMultiply (accRe.data(), im, hImNeg, numBins);
+        juce::FloatVectorOperations::addWithMultiply (accIm.data(), re, hIm, numBins);
+        juce::FloatVectorOperations::addWithMultiply (accIm.data(), im, hRe, numBins);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PartitionedConvolver)
+};
+
+//==============================================================================
+// A built-in convolution reverb. The impulse response file is kept in the state; a stereo
+// file convolves each channel with its own response, a mono one is used for both.
+class ConvolutionPlugin : public tracktion_engine::Plugin
+{
+public:
+    ConvolutionPlugin (tracktion_engine::PluginCreationInfo info) : Plugin (info)
+    {
+        auto um = getUndoManager();
+        impulseFile.referTo (state, impulseFileID, um);
+        mix.referTo (state, mixID, um, 0.3f);
+    }
+
+    ~ConvolutionPlugin() override
+    {
+        notifyListenersOfDeletion();
+    }
+
+    static const char* getPluginName()                      { return NEEDS_TRANS ("Convolution Reverb"); }
+    static constexpr const char* xmlTypeName = "convolutionReverb";
+    static constexpr int partitionSize = 128;
+    static constexpr double maxImpulseSeconds = 10.0;
+
+    juce::String getName() override                         { return TRANS ("Convolution Reverb"); }
+    juce::String getPluginType() override                   { return xmlTypeName; }
+    juce::String getShortName (int) override                { return "Conv"; }
+    int getNumOutputChannelsGivenInputs (int) override      { return 2; }
+    double getTailLength() const override                   { return impulseSeconds; }
+
+    // The convolvers are rebuilt when the property changes, so undo and redo reload the file too
+    void setImpulseResponse (const juce::File& f)
+    {
+        impulseFile = f.getFullPathName();
+    }
+
+    juce::File getImpulseResponse() const                   { return juce::File (impulseFile.get()); }
+
+    void initialise (const tracktion_engine::PluginInitialisationInfo& info) override
+    {
+        wet.setSize (2, juce::jmax (1, info.blockSizeSamples));
+        rebuild();
+    }
+
+    void deinitialise() override {}
+
+    void applyToBuffer (const tracktion_engine::PluginRenderContext& fc) override
+    {
+        if (fc.destBuffer == nullptr)
+            return;
+
+        const juce::SpinLock::ScopedTryLockType lock (convolverLock);
+
+        // Left dry while a new response is being swapped in
+        if (! lock.isLocked() || convolvers.empty())
+            return;
+
+        const auto wetGain = mix.get(), dryGain = 1.0f - wetGain;
+        const auto numChannels = juce::jmin (fc.destBuffer->getNumChannels(), (int) convolvers.size());
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = fc.destBuffer->getWritePointer (ch, fc.bufferStartSample);
+
+            for (int done = 0; done < fc.bufferNumSamples;)
+            {
+                const auto num = juce::jmin (fc.bufferNumSamples - done, wet.getNumSamples());
+                auto* w = wet.getWritePointer (0);
+                convolvers[(size_t) ch]->process (data + done, w, num);
+                juce::FloatVectorOperations::multiply (data + done, dryGain, num);
+                juce::FloatVectorOperations::addWithMultiply (data + done, w, wetGain, num);
+                done += num;
+            }
+        }
+    }
+
+    void restorePluginStateFromValueTree (const juce::ValueTree& v) override
+    {
+        tracktion_engine::copyPropertiesToCachedValues (v, impulseFile, mix);
+    }
+
+    void valueTreePropertyChanged (juce::ValueTree& v, const juce::Identifier& id) override
+    {
+        if (v == state && id == impulseFileID)
+        {
+            impulseFile.forceUpdateOfCachedValue();
+            rebuild();
+        }
+
+        Plugin::valueTreePropertyChanged (v, id);
+    }
+
+    juce::CachedValue<juce::String> impulseFile;
+    juce::CachedValue<float> mix;
+
+private:
+    const juce::Identifier impulseFileID { "impulseFile" }, mixID { "mix" };
+
+    juce::SpinLock convolverLock;
+    std::vector<std::unique_ptr<PartitionedConvolver>> convolvers;
+    juce::AudioBuffer<float> wet;
+    double impulseSeconds = 0.0;
+
+    // Message thread. The new convolvers are built outside the lock and only swapped in under it.
+    void rebuild()
+    {
+        // The block size and sample rate aren't known yet; initialise() builds them
+        if (wet.getNumSamples() == 0)
+            return;
+
+        std::vector<std::unique_ptr<PartitionedConvolver>> newConvolvers;
+        auto ir = loadImpulse (getImpulseResponse());
+
+        for (int ch = 0; ch < (ir.getNumChannels() > 0 ? 2 : 0); ++ch)
+            newConvolvers.push_back (std::make_unique<PartitionedConvolver> (ir.getReadPointer (ch % ir.getNumChannels()), ir.getNumSamples(),
+                                                                               partitionSize, wet.getNumSamples()));
+
+        impulseSeconds = ir.getNumSamples() / sampleRate;
+
+        {
+            const juce::SpinLock::ScopedLockType lock (convolverLock);
+            std::swap (convolvers, newConvolvers);
+        }
+    }
+
+    // Resampled to the current rate; empty if the file can't be read
+    juce::AudioBuffer<float> loadImpulse (const juce::File& f) const
+    {
+        if (! f.existsAsFile())
+            return {};
+
+        std::unique_ptr<juce::AudioFormatReader> reader (engine.getAudioFileFormatManager().readFormatManager.createReaderFor (f));
+
+        if (reader == nullptr || reader->sampleRate <= 0.0)
+            return {};
+
+        const auto numSource = (int) juce::jmin (reader->lengthInSamples, (juce::int64) (maxImpulseSeconds * reader->sampleRate));
+        const auto numChannels = juce::jmin (2, (int) reader->numChannels);
+        juce::AudioBuffer<float> source (numChannels, numSource);
+        reader->read (&source, 0, numSource, 0, true, numChannels > 1);
+
+        const auto ratio = reader->sampleRate / sampleRate;
+
+        if (std::abs (ratio - 1.0) < 1.0e-6)
+            return source;
+
+        juce::AudioBuffer<float> resampled (numChannels, (int) (numSource / ratio));
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process (ratio, source.getReadPointer (ch), resampled.getWritePointer (ch), resampled.getNumSamples());
+        }
+
+        return resampled;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConvolutionPlugin)
+};
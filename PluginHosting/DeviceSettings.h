@@ -0,0 +1,239 @@
+#pragma once
+
+//==============================================================================
+// Finds the smallest buffer size the device handles the current Edit with.
+//
+// The Edit plays while the device is reopened with smaller and smaller buffer sizes, starting
+// from the current one. Each size gets the same settle-then-measure treatment as a HeadroomSweep
+// step. A size counts as stable if there were no overruns or device xruns and the 99th
+// percentile callback load leaves at least safetyMargin of the buffer as slack. Stepping stops
+// at the first unstable size, as smaller ones only get worse. The smallest stable size is kept;
+// if none was stable, the original setup is put back.
+class BufferSizeTuner : private juce::Timer
+{
+public:
+    struct Step
+    {
+        int bufferSize = 0;
+        CallbackHealthMonitor::Snapshot health;
+        int xruns = 0;
+        bool stable = false;
+    };
+
+    BufferSizeTuner (tracktion_engine::Edit& e, CallbackHealthMonitor& m)
+        : edit (e), monitor (m), deviceManager (e.engine.getDeviceManager().deviceManager)
+    {
+    }
+
+    ~BufferSizeTuner() override
+    {
+        if (isRunning())
+            deviceManager.setAudioDeviceSetup (originalSetup, true);
+    }
+
+    // onFinished is called on the message thread with every size tried, largest first
+    void start (double safetyMargin, std::function<void (const std::vector<Step>&)> onFinished)
+    {
+        auto device = deviceManager.getCurrentAudioDevice();
+
+        if (isRunning() || device == nullptr)
+            return;
+
+        margin = juce::jlimit (0.0, 0.9, safetyMargin);
+        finishedCallback = std::move (onFinished);
+        results.clear();
+        stepIndex = 0;
+        originalSetup = deviceManager.getAudioDeviceSetup();
+
+        sizes.clear();
+
+        for (auto size : device->getAvailableBufferSizes())
+            if (size <= device->getCurrentBufferSizeSamples())
+                sizes.push_back (size);
+
+        std::sort (sizes.begin(), sizes.end(), std::greater<int>());
+
+        if (sizes.empty())
+            return;
+
+        wasPlaying = edit.getTransport().isPlaying();
+
+        if (! wasPlaying)
+            edit.getTransport().play (false);
+
+        beginStep();
+    }
+
+    bool isRunning() const      { return isTimerRunning(); }
+
+    static juce::String toText (const std::vector<Step>& steps, double safetyMargin)
+    {
+        juce::String text;
+        text << "Safety margin " << juce::String (safetyMargin * 100.0, 0) << "%\n\n"
+             << "buffer   ms      p99     max     slack   xruns  result\n";
+
+        for (auto& s : steps)
+            text << juce::String (s.bufferSize).paddedRight (' ', 9)
+                 << juce::String (s.health.getBufferMs(), 2).paddedRight (' ', 8)
+                 << (juce::String (s.health.p99Load * 100.0, 1) + "%").paddedRight (' ', 8)
+                 << (juce::String (s.health.maxLoad * 100.0, 1) + "%").paddedRight (' ', 8)
+                 << (juce::String ((1.0 - s.health.p99Load) * 100.0, 1) + "%").paddedRight (' ', 8)
+                 << juce::String (s.xruns + (int) s.health.numOverruns).paddedRight (' ', 7)
+                 << (s.stable ? "stable" : "unstable") << "\n";
+
+        return text;
+    }
+
+private:
+    // Reopening the device takes longer to settle than a graph change
+    static constexpr int settleMs = 1000, measureMs = 3000;
+
+    tracktion_engine::Edit& edit;
+    CallbackHealthMonitor& monitor;
+    juce::AudioDeviceManager& deviceManager;
+    juce::AudioDeviceManager::AudioDeviceSetup originalSetup;
+    std::vector<int> sizes;
+    std::vector<Step> results;
+    std::function<void (const std::vector<Step>&)> finishedCallback;
+    size_t stepIndex = 0;
+    double margin = 0.25;
+    int xrunsAtStart = 0;
+    bool wasPlaying = false, measuring = false;
+
+    void beginStep()
+    {
+        auto setup = deviceManager.getAudioDeviceSetup();
+        setup.bufferSize = sizes[stepIndex];
+        deviceManager.setAudioDeviceSetup (setup, true);
+        measuring = false;
+        startTimer (settleMs);
+    }
+
+    void timerCallback() override
+    {
+        if (! measuring)
+        {
+            monitor.reset();
+            xrunsAtStart = juce::jmax (0, deviceManager.getXRunCount());
+            measuring = true;
+            startTimer (measureMs);
+            return;
+        }
+
+        stopTimer();
+
+        Step step;
+        step.bufferSize = sizes[stepIndex];
+        step.health = monitor.getSnapshot();
+        step.xruns = juce::jmax (0, deviceManager.getXRunCount() - xrunsAtStart);
+        step.stable = step.health.numCallbacks > 0 && step.health.numOverruns == 0 && step.xruns == 0
+                        && step.health.p99Load <= 1.0 - margin;
+        results.push_back (step);
+
+        if (step.stable && ++stepIndex < sizes.size())
+        {
+            beginStep();
+            return;
+        }
+
+        finish();
+    }
+
+    void finish()
+    {
+        stopTimer();
+        auto setup = originalSetup;
+
+        for (auto& s : results)
+            if (s.stable)
+                setup.bufferSize = s.bufferSize;
+
+        deviceManager.setAudioDeviceSetup (setup, true);
+
+        if (! wasPlaying)
+            edit.getTransport().stop (false, false);
+
+        if (finishedCallback != nullptr)
+            finishedCallback (results);
+    }
+};
+
+//==============================================================================
+// The device, sample rate and buffer size choosers, plus the buffer size auto-tune
+class DeviceSettingsComponent : public juce::Component
+{
+public:
+    DeviceSettingsComponent (tracktion_engine::Engine& engine, BufferSizeTuner& t)
+        : tuner (t),
+          selector (engine.getDeviceManager().deviceManager, 0, 256, 1, 256, false, false, true, false)
+    {
+        addAndMakeVisible (selector);
+
+        addAndMakeVisible (tuneButton);
+        tuneButton.setTooltip ("Play the Edit at smaller and smaller buffer sizes and keep the smallest stable one");
+        tuneButton.onClick = [this] { startTuning(); };
+
+        addAndMakeVisible (marginSlider);
+        marginSlider.setSliderStyle (juce::Slider::LinearBar);
+        marginSlider.setRange (0.0, 90.0, 1.0);
+        marginSlider.setTextValueSuffix ("% safety margin");
+        marginSlider.setTooltip ("How much of each buffer's time must be left over at the 99th percentile callback load");
+
+        if (auto settings = tracktion_engine::getApplicationSettings())
+            marginSlider.setValue (settings->getDoubleValue (marginSetting, 25.0), juce::dontSendNotification);
+
+        addAndMakeVisible (resultLabel);
+        resultLabel.setFont (juce::Font (juce::Font::getDefaultMonospacedFontName(), 12.0f, juce::Font::plain));
+        resultLabel.setJustificationType (juce::Justification::topLeft);
+
+        setSize (520, 560);
+    }
+
+    void resized() override
+    {
+        auto b = getLocalBounds().reduced (10);
+        resultLabel.setBounds (b.removeFromBottom (150));
+        auto tuneRow = b.removeFromBottom (24);
+        tuneButton.setBounds (tuneRow.removeFromLeft (160));
+        marginSlider.setBounds (tuneRow.withTrimmedLeft (6));
+        selector.setBounds (b.withTrimmedBottom (6));
+    }
+
+private:
+    static constexpr const char* marginSetting = "bufferTuneSafetyMarginPercent";
+
+    BufferSizeTuner& tuner;
+    juce::AudioDeviceSelectorComponent selector;
+    juce::TextButton tuneButton { "Auto-tune Buffer Size" };
+    juce::Slider marginSlider;
+    juce::Label resultLabel;
+
+    void startTuning()
+    {
+        const auto margin = marginSlider.getValue() / 100.0;
+
+        if (auto settings = tracktion_engine::getApplicationSettings())
+            settings->setValue (marginSetting, marginSlider.getValue());
+
+        tuneButton.setEnabled (false);
+        resultLabel.setText ("Tuning...", juce::dontSendNotification);
+
+        tuner.start (margin, [sp = juce::Component::SafePointer<DeviceSettingsComponent> (this), margin] (const std::vector<BufferSizeTuner::Step>& steps)
+                     {
+                         auto report = BufferSizeTuner::toText (steps, margin);
+                         juce::Logger::writeToLog (report);
+
+                         if (sp != nullptr)
+                         {
+                             sp->tuneButton.setEnabled (true);
+                             sp->resultLabel.setText (report, juce::dontSendNotification);
+                         }
+                     });
+
+        if (! tuner.isRunning())
+        {
+            tuneButton.setEnabled (true);
+            resultLabel.setText ("No audio device is open", juce::dontSendNotification);
+        }
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+// ====== These functions borrowed from Tracktion's examples/common/Utilities.h
+//=============================================================================
+namespace EngineHelpers
+{
+    void browseForAudioFile (tracktion_engine::Engine& engine, std::function<void (const juce::File&)> fileChosenCallback)
+    {
+        auto fc = std::make_shared<juce::FileChooser> ("Please select an audio file to load...",
+                                                 engine.getPropertyStorage().getDefaultLoadSaveDirectory ("pitchAndTimeExample"),
+                                                 engine.getAudioFileFormatManager().readFormatManager.getWildcardForAllFormats());
+
+        fc->launchAsync (juce::FileBrowserComponent::openMode + juce::FileBrowserComponent::canSelectFiles,
+                         [fc, &engine, callback = std::move (fileChosenCallback)] (const juce::FileChooser&)
+                         {
+                             const auto f = fc->getResult();
+
+                             if (f.existsAsFile())
+                                 engine.getPropertyStorage().setDefaultLoadSaveDirectory ("pitchAndTimeExample", f.getParentDirectory());
+
+                             callback (f);
+                         });
+    }
+    tracktion_engine::AudioTrack* getOrInsertAudioTrackAt (tracktion_engine::Edit& edit, int index)
+    {
+        edit.ensureNumberOfAudioTracks (index + 1);
+        return tracktion_engine::getAudioTracks (edit)[index];
+    }
+    void removeAllClips (tracktion_engine::AudioTrack& track)
+    {
+        auto clips = track.getClips();
+
+        for (int i = clips.size(); --i >= 0;)
+            clips.getUnchecked (i)->removeFromParentTrack();
+    }
+
+    tracktion_engine::WaveAudioClip::Ptr loadAudioFileAsClip (tracktion_engine::AudioTrack& track, const File& file)
+    {
+        // Delete all clips from the track
+        removeAllClips (track);
+
+        // Add a new clip to this track
+        tracktion_engine::AudioFile audioFile (track.edit.engine, file);
+
+        if (audioFile.isValid())
+            if (auto newClip = track.insertWaveClip (file.getFileNameWithoutExtension(), file,
+                                                     { { 0.0, audioFile.getLength() }, 0.0 }, false))
+                return newClip;
+
+        return {};
+    }
+    tracktion_engine::WaveAudioClip::Ptr loadAudioFileAsClip (tracktion_engine::Edit& edit, const File& file)
+    {
+        // Loads onto the first track
+        if (auto track = getOrInsertAudioTrackAt (edit, 0))
+            return loadAudioFileAsClip (*track, file);
+
+        return {};
+    }
+    template<typename ClipType>
+    typename ClipType::Ptr loopAroundClip (ClipType& clip)
+    {
+        auto& transport = clip.edit.getTransport();
+        transport.setLoopRange (clip.getEditTimeRange());
+        transport.looping = true;
+        transport.position = 0.0;
+        transport.play (false);
+
+        return clip;
+    }
+    class FlaggedAsyncUpdater : public AsyncUpdater
+    {
+    public:
+        //==============================================================================
+        void markAndUpdate (bool& flag)     { flag = true; triggerAsyncUpdate(); }
+        
+        bool compareAndReset (bool& flag) noexcept
+        {
+            if (! flag)
+                return false;
+            
+            flag = false;
+            return true;
+        }
+    };
+}
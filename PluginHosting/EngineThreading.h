@@ -0,0 +1,62 @@
+#pragma once
+
+//==============================================================================
+// Lets the number of audio worker threads be changed while the app runs.
+// The engine asks for it whenever a playback context is created, so changes take effect the
+// next time the Edit's context is rebuilt (see EngineThreading::apply).
+// The audio device isn't opened by the engine's constructor; MainComponent opens it once the
+// window is up, so it doesn't hold up the first paint.
+class HostEngineBehaviour : public tracktion_engine::EngineBehaviour
+{
+public:
+    int getNumberOfCPUsToUseForAudio() override     { return numAudioThreads.load(); }
+    bool autoInitialiseDeviceManager() override     { return false; }
+
+    std::atomic<int> numAudioThreads { juce::jmax (1, juce::SystemStats::getNumCpus() / 2) };
+};
+
+//==============================================================================
+namespace EngineThreading
+{
+    static constexpr const char* threadsSetting  = "audioThreads";
+    static constexpr const char* strategySetting = "audioThreadPoolStrategy";
+
+    // In the order of tracktion_graph::ThreadPoolStrategy
+    juce::StringArray getStrategyNames()
+    {
+        return { "Condition variable", "Realtime", "Hybrid", "Semaphore", "Lightweight semaphore", "Lightweight hybrid" };
+    }
+
+    // Independent tracks are processed in parallel by the playback context's thread pool.
+    // Its size and strategy are fixed when the context is created, so it's rebuilt here.
+    void apply (tracktion_engine::Edit& edit, int numThreads, int strategy)
+    {
+        auto& behaviour = dynamic_cast<HostEngineBehaviour&> (edit.engine.getEngineBehaviour());
+        behaviour.numAudioThreads = juce::jlimit (1, juce::SystemStats::getNumCpus(), numThreads);
+        tracktion_engine::EditPlaybackContext::setThreadPoolStrategy (strategy);
+
+        auto& transport = edit.getTransport();
+        const bool wasPlaying = transport.isPlaying();
+
+        transport.freePlaybackContext();
+        transport.ensureContextAllocated();
+
+        if (wasPlaying)
+            transport.play (false);
+
+        if (auto settings = tracktion_engine::getApplicationSettings())
+        {
+            settings->setValue (threadsSetting, behaviour.numAudioThreads.load());
+            settings->setValue (strategySetting, strategy);
+        }
+    }
+
+    // Re-applies whatever was chosen last time the app ran
+    void restore (tracktion_engine::Edit& edit)
+    {
+        if (auto settings = tracktion_engine::getApplicationSettings())
+            if (settings->containsKey (threadsSetting))
+                apply (edit, settings->getIntValue (threadsSetting),
+                       settings->getIntValue (strategySetting, tracktion_engine::EditPlaybackContext::getThreadPoolStrategy()));
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+//==============================================================================
+// Measures how CPU headroom shrinks as tracks are added.
+//
+// Track 0's clips and plugin chain are copied onto more and more tracks, added after the user's
+// own. At each step the Edit plays for a while and the CallbackHealthMonitor's load figures are
+// recorded. The user's tracks are never touched, so a step asking for fewer tracks than the Edit
+// already has just measures the Edit as it is. The copies are deleted when the sweep finishes,
+// and the transport is put back as it was.
+class HeadroomSweep : private juce::Timer
+{
+public:
+    struct Step
+    {
+        int numTracks = 0;
+        CallbackHealthMonitor::Snapshot health;
+    };
+
+    HeadroomSweep (tracktion_engine::Edit& e, CallbackHealthMonitor& m) : edit (e), monitor (m) {}
+
+    // onFinished is called on the message thread with one Step per entry of trackCounts
+    void start (std::vector<int> trackCounts, std::function<void (const std::vector<Step>&)> onFinished)
+    {
+        if (isRunning() || trackCounts.empty())
+            return;
+
+        counts = std::move (trackCounts);
+        finishedCallback = std::move (onFinished);
+        results.clear();
+        stepIndex = 0;
+        numOriginalTracks = tracktion_engine::getAudioTracks (edit).size();
+        clones.clear();
+        wasPlaying = edit.getTransport().isPlaying();
+
+        if (! wasPlaying)
+            edit.getTransport().play (false);
+
+        beginStep();
+    }
+
+    bool isRunning() const      { return isTimerRunning(); }
+
+    static juce::String toText (const std::vector<Step>& steps, int numThreads, const juce::String& strategy)
+    {
+        juce::String text;
+        text << numThreads << " audio threads, " << strategy << " strategy\n\n"
+             << "tracks   mean    p99     max     headroom  overruns\n";
+
+        for (auto& s : steps)
+            text << juce::String (s.numTracks).paddedRight (' ', 9)
+                 << (juce::String (s.health.meanLoad * 100.0, 1) + "%").paddedRight (' ', 8)
+                 << (juce::String (s.health.p99Load * 100.0, 1) + "%").paddedRight (' ', 8)
+                 << (juce::String (s.health.maxLoad * 100.0, 1) + "%").paddedRight (' ', 8)
+                 << (juce::String ((1.0 - s.health.p99Load) * 100.0, 1) + "%").paddedRight (' ', 10)
+                 << (juce::int64) s.health.numOverruns << "\n";
+
+        return text;
+    }
+
+private:
+    // Graph rebuilds and plugin preparation make the first callbacks after a change unrepresentative
+    static constexpr int settleMs = 750, measureMs = 2000;
+
+    tracktion_engine::Edit& edit;
+    CallbackHealthMonitor& monitor;
+    std::vector<int> counts;
+    std::vector<Step> results;
+    std::function<void (const std::vector<Step>&)> finishedCallback;
+    size_t stepIndex = 0;
+    int numOriginalTracks = 0;
+    juce::ReferenceCountedArray<tracktion_engine::AudioTrack> clones;
+    bool wasPlaying = false, measuring = false;
+
+    void beginStep()
+    {
+        setNumTracks (counts[stepIndex]);
+        measuring = false;
+        startTimer (settleMs);
+    }
+
+    void timerCallback() override
+    {
+        if (! measuring)
+        {
+            monitor.reset();
+            measuring = true;
+            startTimer (measureMs);
+            return;
+        }
+
+        stopTimer();
+        results.push_back ({ numOriginalTracks + clones.size(), monitor.getSnapshot() });
+
+        if (++stepIndex < counts.size())
+        {
+            beginStep();
+            return;
+        }
+
+        setNumTracks (0);
+
+        if (! wasPlaying)
+            edit.getTransport().stop (false, false);
+
+        if (finishedCallback != nullptr)
+            finishedCallback (results);
+    }
+
+    // Only ever adds or deletes copies, after the user's tracks
+    void setNumTracks (int numTracks)
+    {
+        const auto numClones = juce::jmax (0, numTracks - numOriginalTracks);
+
+        while (clones.size() > numClones)
+        {
+            edit.deleteTrack (clones.getLast().get());
+            clones.removeLast();
+        }
+
+        auto source = tracktion_engine::getAudioTracks (edit).getFirst();
+
+        while (source != nullptr && clones.size() < numClones)
+        {
+            auto clone = EngineHelpers::getOrInsertAudioTrackAt (edit, tracktion_engine::getAudioTracks (edit).size());
+            copyTrackContent (*source, *clone);
+            clones.add (clone);
+        }
+    }
+
+    static void copyTrackContent (tracktion_engine::AudioTrack& source, tracktion_engine::AudioTrack& dest)
+    {
+        EngineHelpers::removeAllClips (dest);
+
+        for (auto p : dest.pluginList.getPlugins())
+            p->deleteFromParent();
+
+        for (auto p : source.pluginList)
+        {
+            source.edit.flushPluginStateIfNeeded (*p);
+            auto state = p->state.createCopy();
+            source.edit.createNewItemID().writeID (state, nullptr);
+            dest.pluginList.insertPlugin (state, -1);
+        }
+
+        for (auto c : source.getClips())
+            if (auto wave = dynamic_cast<tracktion_engine::WaveAudioClip*> (c))
+                dest.insertWaveClip (wave->getName(), wave->getOriginalFile(), wave->getPosition(), false);
+    }
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+//==============================================================================
+// Keeps each track's plugin chain within a latency budget while live mode is on.
+//
+// The latency of a chain is the sum of what its enabled plugins report. While live mode is on,
+// any track over budget has its highest-latency plugins disabled, one at a time, until it fits.
+// A disabled plugin is left out of the playback graph, so the engine's delay compensation
+// shrinks with it, and the graph is swapped in as a whole, so the audio thread never sees a
+// half-updated chain. Only plugins disabled here are re-enabled when live mode is turned off
+// or the budget is raised; plugins the user disabled are left alone.
+// Each check works out the whole set of plugins that should be disabled and then only changes
+// the ones that differ from the last check, so an unchanged set doesn't touch the graph. Chains
+// are re-checked a few times a second, as plugins can change their latency at any time, and a
+// new budget is applied once it has stopped changing for a moment, so dragging the budget
+// doesn't rebuild the graph on every step.
+class LiveLatencyGuard : private juce::Timer
+{
+public:
+    LiveLatencyGuard (tracktion_engine::Edit& e) : edit (e) {}
+
+    // Whatever was listening may already be gone, so this doesn't notify
+    ~LiveLatencyGuard() override
+    {
+        stopTimer();
+        apply ({}, false);
+    }
+
+    void setLiveMode (bool shouldBeLive)
+    {
+        if (shouldBeLive == live)
+            return;
+
+        live = shouldBeLive;
+
+        if (live)
+        {
+            startTimer (checkIntervalMs);
+            enforce();
+        }
+        else
+        {
+            stopTimer();
+            apply ({}, true);
+        }
+    }
+
+    bool isLiveMode() const                             { return live; }
+
+    void setBudgetMs (double newBudget)
+    {
+        budgetMs = juce::jmax (0.0, newBudget);
+
+        if (live)
+            startTimer (budgetSettleMs);
+    }
+
+    double getBudgetMs() const                          { return budgetMs; }
+
+    bool isBypassedForLatency (const tracktion_engine::Plugin& p) const
+    {
+        return bypassed.find (p.itemID.toString()) != bypassed.end();
+    }
+
+    int getNumBypassed() const                          { return (int) bypassed.size(); }
+
+    // Lets go of a plugin that's about to be deleted, without re-enabling it
+    void forget (tracktion_engine::Plugin& p)
+    {
+        if (bypassed.erase (p.itemID.toString()) > 0 && onChanged != nullptr)
+            onChanged (getNumBypassed());
+    }
+
+    // Plugins that are only disabled because of live mode are saved as enabled
+    void restoreInTree (juce::ValueTree& editState) const
+    {
+        if (bypassed.find (editState[tracktion_engine::IDs::id].toString()) != bypassed.end())
+            editState.setProperty (tracktion_engine::IDs::enabled, true, nullptr);
+
+        for (auto child : editState)
+            restoreInTree (child);
+    }
+
+    static double getChainLatencyMs (tracktion_engine::AudioTrack& track)
+    {
+        double seconds = 0.0;
+
+        for (auto p : track.pluginList)
+            if (p->isEnabled())
+                seconds += p->getLatencySeconds();
+
+        return seconds * 1000.0;
+    }
+
+    // Called on the message thread with the number of bypassed plugins whenever it changes
+    std::function<void (int)> onChanged;
+
+private:
+    static constexpr int checkIntervalMs = 250, budgetSettleMs = 300;
+
+    using PluginSet = std::map<juce::String, tracktion_engine::Plugin::Ptr>;
+
+    tracktion_engine::Edit& edit;
+    bool live = false;
+    double budgetMs = 10.0;
+    PluginSet bypassed;
+
+    void timerCallback() override
+    {
+        if (getTimerInterval() != checkIntervalMs)
+            startTimer (checkIntervalMs);
+
+        enforce();
+    }
+
+    void enforce()
+    {
+        apply (findPluginsToBypass(), true);
+    }
+
+    // Plugins bypassed here count as enabled, as they'd be if the budget allowed
+    PluginSet findPluginsToBypass() const
+    {
+        PluginSet toBypass;
+
+        for (auto track : tracktion_engine::getAudioTracks (edit))
+        {
+            std::vector<tracktion_engine::Plugin::Ptr> candidates;
+            double latencyMs = 0.0;
+
+            for (auto p : track->pluginList)
+            {
+                if (p->isEnabled() || isBypassedForLatency (*p))
+                {
+                    latencyMs += p->getLatencySeconds() * 1000.0;
+
+                    if (p->getLatencySeconds() > 0.0)
+                        candidates.push_back (p);
+                }
+            }
+
+            std::stable_sort (candidates.begin(), candidates.end(),
+                              [] (auto& a, auto& b) { return a->getLatencySeconds() > b->getLatencySeconds(); });
+
+            for (auto& p : candidates)
+            {
+                if (latencyMs <= budgetMs)
+                    break;
+
+                latencyMs -= p->getLatencySeconds() * 1000.0;
+                toBypass[p->itemID.toString()] = p;
+            }
+        }
+
+        return toBypass;
+    }
+
+    void apply (PluginSet toBypass, bool notify)
+    {
+        bool changed = false;
+
+        for (auto& [id, plugin] : bypassed)
+        {
+            if (toBypass.find (id) == toBypass.end())
+            {
+                plugin->setEnabled (true);
+                changed = true;
+            }
+        }
+
+        for (auto& [id, plugin] : toBypass)
+        {
+            if (bypassed.find (id) == bypassed.end())
+                changed = true;
+
+            if (plugin->isEnabled())
+                plugin->setEnabled (false);
+        }
+
+        bypassed = std::move (toBypass);
+
+        if (changed && notify && onChanged != nullptr)
+            onChanged (getNumBypassed());
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (LiveLatencyGuard)
+};
@@ -6,212 +6,793 @@
 #include <JuceHeader.h>
 #include "PluginStuff.h"
 #include "PluginWindow.h"
+#include "EngineHelpers.h"
+#include "CallbackHealthMonitor.h"
+#include "PluginScanner.h"
+#include "PluginSearch.h"
+#include "PluginInstancePool.h"
+#include "AsyncPluginLoader.h"
+#include "ValueTreeReconciler.h"
+#include "EngineThreading.h"
+#include "HeadroomSweep.h"
+#include "StreamingAudioLoader.h"
+#include "WaveformOverview.h"
+#include "BinarySession.h"
+#include "LiveLatencyGuard.h"
+#include "TrackFreezer.h"
+#include "StartupTimer.h"
+#include "DeviceSettings.h"
+#include "PresetLibrary.h"
+#include "AutomationRecorder.h"
+#include "MidiInput.h"
 
-// ====== These functions borrowed from Tracktion's examples/common/Utilities.h
-//=============================================================================
-namespace EngineHelpers
+//======================================================================================
+//===This class massaged from tracktion_engine/examples/PluginDemo.h====================
+class TrackPluginListComponent : public juce::Component,
+                                 private EngineHelpers::FlaggedAsyncUpdater,
+                                 private tracktion_engine::ValueTreeAllEventListener,
+                                 private juce::Timer
 {
-    void browseForAudioFile (tracktion_engine::Engine& engine, std::function<void (const juce::File&)> fileChosenCallback)
+public:
+    TrackPluginListComponent(tracktion_engine::AudioTrack& t, PluginMenuCache& menu, AsyncPluginLoader& loader, PluginInstancePool& pool)
+      :  edit(t.edit), 
+         pluginMenu(menu),
+         pluginLoader(loader),
+         pluginPool(pool),
+         track(&t)
     {
-        auto fc = std::make_shared<juce::FileChooser> ("Please select an audio file to load...",
-                                                 engine.getPropertyStorage().getDefaultLoadSaveDirectory ("pitchAndTimeExample"),
-                                                 engine.getAudioFileFormatManager().readFormatManager.getWildcardForAllFormats());
-
-        fc->launchAsync (juce::FileBrowserComponent::openMode + juce::FileBrowserComponent::canSelectFiles,
-                         [fc, &engine, callback = std::move (fileChosenCallback)] (const juce::FileChooser&)
-                         {
-                             const auto f = fc->getResult();
 
-                             if (f.existsAsFile())
-                                 engine.getPropertyStorage().setDefaultLoadSaveDirectory ("pitchAndTimeExample", f.getParentDirectory());
-
-                             callback (f);
-                         });
+        track->state.addListener(this);
+        addAndMakeVisible(&addPluginButton);
+        addPluginButton.onClick = [this]()
+        {
+            if(auto type = pluginMenu.showMenu())
+                loadPlugin(*type);
+        };
+        addAndMakeVisible(&findPluginButton);
+        findPluginButton.onClick = [this]()
+        {
+            auto search = std::make_unique<PluginSearchComponent>(pluginMenu, 
+                                                                  [sp = SafePointer<TrackPluginListComponent>(this)](int id)
+                                                                  {
+                                                                      if(sp != nullptr)
+                                                                          if(auto type = sp->pluginMenu.findItem(id))
+                                                                              sp->loadPlugin(*type);
+                                                                  });
+            juce::CallOutBox::launchAsynchronously(std::move(search), findPluginButton.getScreenBounds(), nullptr);
+        };
+        addAndMakeVisible(&latencyLabel);
+        latencyLabel.setFont(12.0f);
+        latencyLabel.setTooltip("Total latency reported by the enabled plugins in this chain");
+        updatePluginButtons();
+        startTimerHz(4);
+    }
+    ~TrackPluginListComponent() override 
+    {
+        track->state.removeListener(this);
     }
-    tracktion_engine::AudioTrack* getOrInsertAudioTrackAt (tracktion_engine::Edit& edit, int index)
+
+    void resized() override 
     {
-        edit.ensureNumberOfAudioTracks (index + 1);
-        return tracktion_engine::getAudioTracks (edit)[index];
+        int spacer = 2;
+        auto b = getLocalBounds();
+        for(int i = 0; i < plugins.size(); ++i)
+        {
+            plugins[i]->setBounds(b.removeFromTop(20));
+            b.removeFromTop(spacer);
+        }
+        for(auto p : pending)
+        {
+            p->setBounds(b.removeFromTop(20));
+            b.removeFromTop(spacer);
+        }
+        auto buttonRow = b.removeFromTop(20);
+        addPluginButton.setBounds(buttonRow.removeFromLeft(40));
+        findPluginButton.setBounds(buttonRow.withTrimmedLeft(spacer));
+        latencyLabel.setBounds(b.removeFromTop(20));
     }
-    void removeAllClips (tracktion_engine::AudioTrack& track)
+private:
+    // Shows a placeholder straight away and swaps the plugin in once it has loaded.
+    // Plugins are added in the order they were asked for, whichever finishes loading first.
+    void loadPlugin(const PluginTreeItem& type)
     {
-        auto clips = track.getClips();
+        auto placeholder = pending.add(std::make_unique<PluginPlaceholderComponent>(type.desc.name));
+        addAndMakeVisible(placeholder);
+        resized();
 
-        for (int i = clips.size(); --i >= 0;)
-            clips.getUnchecked (i)->removeFromParentTrack();
+        pluginLoader.load(type.desc, type.xmlType,
+                          [sp = SafePointer<TrackPluginListComponent>(this), 
+                           slot = SafePointer<PluginPlaceholderComponent>(placeholder)](tracktion_engine::Plugin::Ptr plugin)
+                          {
+                              if(sp == nullptr || slot == nullptr)
+                                  return;
+
+                              slot->plugin = plugin;
+                              slot->finished = true;
+                              sp->addFinishedPlugins();
+                          });
     }
 
-    tracktion_engine::WaveAudioClip::Ptr loadAudioFileAsClip (tracktion_engine::Edit& edit, const File& file)
+    void addFinishedPlugins()
     {
-        // Find the first track and delete all clips from it
-        if (auto track = getOrInsertAudioTrackAt (edit, 0))
+        while(! pending.isEmpty() && pending.getFirst()->finished)
         {
-            removeAllClips (*track);
-
-            // Add a new clip to this track
-            tracktion_engine::AudioFile audioFile (edit.engine, file);
+            if(auto plugin = pending.getFirst()->plugin)
+                addPlugin(plugin);
 
-            if (audioFile.isValid())
-                if (auto newClip = track->insertWaveClip (file.getFileNameWithoutExtension(), file,
-                                                          { { 0.0, audioFile.getLength() }, 0.0 }, false))
-                    return newClip;
+            pending.remove(0);
         }
+        resized();
+    }
 
+    void addPlugin(tracktion_engine::Plugin::Ptr plugin)
+    {
+        track->pluginList.insertPlugin(plugin, track->pluginList.size(), nullptr);
+        updatePluginButtons();
+    }
+
+    std::unique_ptr<PluginComponent> createPluginComponent(const juce::ValueTree& v)
+    {
+        for(auto plugin : track->pluginList)
+        {
+            if(plugin->state == v)
+            {
+                auto p = std::make_unique<PluginComponent>(plugin);
+                p->onDeleteRequested = [this](tracktion_engine::Plugin::Ptr pl){pluginPool.release(pl);};
+                return p;
+            }
+        }
         return {};
     }
-    template<typename ClipType>
-    typename ClipType::Ptr loopAroundClip (ClipType& clip)
+
+    void valueTreeChanged() override {}
+    // Only the track's own PLUGIN children matter here, not changes further down the tree
+    void valueTreeChildAdded (juce::ValueTree& p, juce::ValueTree& c) override
+    {
+        if(p == track->state && c.hasType(tracktion_engine::IDs::PLUGIN))
+            markAndUpdate(needsUpdate);
+    }
+    void valueTreeChildRemoved (juce::ValueTree& p, juce::ValueTree& c, int) override
+    {
+        if(p == track->state && c.hasType(tracktion_engine::IDs::PLUGIN))
+            markAndUpdate(needsUpdate);
+    }
+    void valueTreeChildOrderChanged (juce::ValueTree& p, int, int) override
     {
-        auto& transport = clip.edit.getTransport();
-        transport.setLoopRange (clip.getEditTimeRange());
-        transport.looping = true;
-        transport.position = 0.0;
-        transport.play (false);
+        if(p == track->state)
+            markAndUpdate(needsUpdate);
+    }
 
-        return clip;
+    void handleAsyncUpdate() override
+    {
+        if(compareAndReset(needsUpdate))
+            updatePluginButtons();
     }
-    class FlaggedAsyncUpdater : public AsyncUpdater
+
+    void updatePluginButtons()
     {
-    public:
-        //==============================================================================
-        void markAndUpdate (bool& flag)     { flag = true; triggerAsyncUpdate(); }
-        
-        bool compareAndReset (bool& flag) noexcept
-        {
-            if (! flag)
-                return false;
-            
-            flag = false;
-            return true;
-        }
-    };
-}
-//======================================================================================
-//===This class massaged from tracktion_engine/examples/PluginDemo.h====================
-class TrackPluginListComponent : public juce::Component,
-                                 private EngineHelpers::FlaggedAsyncUpdater,
-                                 private tracktion_engine::ValueTreeAllEventListener
+        if(plugins.reconcile(track->state).any())
+            resized();
+    }
+
+    void timerCallback() override
+    {
+        auto latencyMs = LiveLatencyGuard::getChainLatencyMs(*track);
+        latencyLabel.setText("Latency: " + juce::String(latencyMs, 1) + " ms", juce::dontSendNotification);
+    }
+
+    tracktion_engine::Edit& edit;
+    PluginMenuCache& pluginMenu;
+    AsyncPluginLoader& pluginLoader;
+    PluginInstancePool& pluginPool;
+    tracktion_engine::Track::Ptr track;
+    juce::TextButton addPluginButton {"+"}, findPluginButton {"Find"};
+    juce::Label latencyLabel;
+    ValueTreeReconciler<PluginComponent> plugins { *this, tracktion_engine::IDs::PLUGIN,
+                                                   [this](const juce::ValueTree& v){ return createPluginComponent(v); } };
+    juce::OwnedArray<PluginPlaceholderComponent> pending;
+
+    bool needsUpdate = false; //async update flag
+};
+//==========================================================================================
+// One column per audio track: its name, a button to load a clip onto it, and its plugin chain
+class TrackLaneComponent : public juce::Component
 {
 public:
-    TrackPluginListComponent(tracktion_engine::Edit& e)
-      :  edit(e), 
-         track(EngineHelpers::getOrInsertAudioTrackAt(edit, 0))
+    TrackLaneComponent(tracktion_engine::AudioTrack& t, PluginMenuCache& menu, AsyncPluginLoader& loader, PluginInstancePool& pool,
+                       StreamingAudioLoader& audioLoader, TrackFreezer& trackFreezer)
+      :  track(&t),
+         audioFileLoader(audioLoader),
+         freezer(trackFreezer),
+         pluginList(t, menu, loader, pool)
     {
-
-        track->state.addListener(this);
-        addAndMakeVisible(&addPluginButton);
-        addPluginButton.onClick = [this]()
+        nameLabel.setText(track->getName(), juce::dontSendNotification);
+        addAndMakeVisible(&nameLabel);
+        addAndMakeVisible(&loadButton);
+        loadButton.onClick = [this]()
         {
-            if(auto plugin = showMenuAndCreatePlugin(edit))
-            {
-                auto track = EngineHelpers::getOrInsertAudioTrackAt(edit, 0);
-                track->pluginList.insertPlugin(plugin, plugins.size(), nullptr);
-                auto p = plugins.add(std::make_unique<PluginComponent>(plugin));
-                addAndMakeVisible(p);
-                resized();
-            }
+            EngineHelpers::browseForAudioFile(track->edit.engine, 
+                                              [sp = SafePointer<TrackLaneComponent>(this)](const juce::File& file)
+                                              {
+                                                  if(sp != nullptr && file != juce::File())
+                                                      sp->audioFileLoader.loadAndLoop(*sp->track, file);
+                                              });
         };
-        rebuildPluginButtons();
+        addAndMakeVisible(&freezeButton);
+        freezeButton.onClick = [this](){toggleFreeze();};
+        addAndMakeVisible(&pluginList);
+        updateFreezeButton();
     }
-    ~TrackPluginListComponent() override 
+
+    void resized() override
     {
-        track->state.removeListener(this);
+        auto b = getLocalBounds();
+        auto header = b.removeFromTop(20);
+        freezeButton.setBounds(header.removeFromRight(50));
+        loadButton.setBounds(header.removeFromRight(40));
+        nameLabel.setBounds(header);
+        pluginList.setBounds(b.withTrimmedTop(2));
+    }
+private:
+    void toggleFreeze()
+    {
+        if(freezer.isFrozen(*track))
+            freezer.unfreeze(*track);
+        else
+            freezer.freeze(*track, [sp = SafePointer<TrackLaneComponent>(this)](bool){if(sp != nullptr) sp->updateFreezeButton();});
+        updateFreezeButton();
+    }
+    void updateFreezeButton()
+    {
+        const bool frozen = freezer.isFrozen(*track), freezing = freezer.isFreezing(*track);
+        freezeButton.setButtonText(freezing ? "..." : (frozen ? "Unfreeze" : "Freeze"));
+        freezeButton.setEnabled(!freezing);
+        // Loading a file would replace the frozen clip
+        loadButton.setEnabled(!frozen && !freezing);
     }
 
-    void resized() override 
+    tracktion_engine::AudioTrack::Ptr track;
+    StreamingAudioLoader& audioFileLoader;
+    TrackFreezer& freezer;
+    juce::Label nameLabel;
+    juce::TextButton loadButton {"SF"};
+    juce::TextButton freezeButton {"Freeze"};
+    TrackPluginListComponent pluginList;
+};
+//==========================================================================================
+// Lays out a lane per audio track, side by side, following the Edit's TRACK children
+class TrackLanesComponent : public juce::Component,
+                            private EngineHelpers::FlaggedAsyncUpdater,
+                            private tracktion_engine::ValueTreeAllEventListener
+{
+public:
+    TrackLanesComponent(tracktion_engine::Edit& e, PluginMenuCache& menu, AsyncPluginLoader& loader, PluginInstancePool& pool,
+                        StreamingAudioLoader& audioLoader, TrackFreezer& trackFreezer)
+      :  edit(e),
+         pluginMenu(menu),
+         pluginLoader(loader),
+         pluginPool(pool),
+         audioFileLoader(audioLoader),
+         freezer(trackFreezer)
     {
-        int spacer = 2;
-        auto b = getBounds();
-        for(auto p : plugins)
+        EngineHelpers::getOrInsertAudioTrackAt(edit, 0);
+        edit.state.addListener(this);
+        updateLanes();
+    }
+    ~TrackLanesComponent() override
+    {
+        edit.state.removeListener(this);
+    }
+
+    void resized() override
+    {
+        auto b = getLocalBounds();
+        for(int i = 0; i < lanes.size(); ++i)
         {
-            p->setBounds(b.removeFromTop(20).withWidth(40));
-            b.removeFromTop(spacer);
+            lanes[i]->setBounds(b.removeFromLeft(laneWidth).withTrimmedRight(spacer));
         }
-        addPluginButton.setBounds(b.removeFromTop(20).withWidth(40));
     }
 private:
+    static constexpr int laneWidth = 180, spacer = 6;
+
+    std::unique_ptr<TrackLaneComponent> createLane(const juce::ValueTree& v)
+    {
+        for(auto t : tracktion_engine::getAudioTracks(edit))
+            if(t->state == v)
+                return std::make_unique<TrackLaneComponent>(*t, pluginMenu, pluginLoader, pluginPool, audioFileLoader, freezer);
+
+        return {};
+    }
+
+    void updateLanes()
+    {
+        if(lanes.reconcile(edit.state).any())
+        {
+            setSize(lanes.size() * laneWidth, getHeight());
+            resized();
+        }
+    }
+
     void valueTreeChanged() override {}
-    void valueTreeChildAdded (juce::ValueTree&, juce::ValueTree& c) override
+    void valueTreeChildAdded (juce::ValueTree& p, juce::ValueTree& c) override
     {
-        if(c.hasType(tracktion_engine::IDs::PLUGIN))
+        if(p == edit.state && c.hasType(tracktion_engine::IDs::TRACK))
             markAndUpdate(needsUpdate);
     }
-    void valueTreeChildRemoved (juce::ValueTree&, juce::ValueTree& c, int) override
+    void valueTreeChildRemoved (juce::ValueTree& p, juce::ValueTree& c, int) override
     {
-        if(c.hasType(tracktion_engine::IDs::PLUGIN))
+        if(p == edit.state && c.hasType(tracktion_engine::IDs::TRACK))
             markAndUpdate(needsUpdate);
     }
-    void valueTreeChildOrderChanged (juce::ValueTree&, int, int) override
+    void valueTreeChildOrderChanged (juce::ValueTree& p, int, int) override
     {
-        markAndUpdate(needsUpdate);
+        if(p == edit.state)
+            markAndUpdate(needsUpdate);
     }
 
     void handleAsyncUpdate() override
     {
         if(compareAndReset(needsUpdate))
-            rebuildPluginButtons();
+            updateLanes();
     }
 
-    void rebuildPluginButtons()
+    tracktion_engine::Edit& edit;
+    PluginMenuCache& pluginMenu;
+    AsyncPluginLoader& pluginLoader;
+    PluginInstancePool& pluginPool;
+    StreamingAudioLoader& audioFileLoader;
+    TrackFreezer& freezer;
+    ValueTreeReconciler<TrackLaneComponent> lanes { *this, tracktion_engine::IDs::TRACK,
+                                                    [this](const juce::ValueTree& v){ return createLane(v); } };
+
+    bool needsUpdate = false; //async update flag
+};
+//==========================================================================================
+// Everything that belongs to one Edit, so it can all be replaced when a session is opened
+struct EditSession
+{
+    EditSession(std::unique_ptr<tracktion_engine::Edit> e, CallbackHealthMonitor& monitor)
+      :  edit(std::move(e)),
+         pluginMenu(*edit),
+         pluginPool(*edit),
+         pluginLoader(*edit, pluginPool),
+         audioFileLoader(edit->engine),
+         headroomSweep(*edit, monitor),
+         liveGuard(*edit),
+         freezer(*edit, pluginPool, liveGuard),
+         bufferTuner(*edit, monitor),
+         automationRecorder(*edit),
+         midiRouter(*edit)
+    {
+    }
+    ~EditSession()
     {
-        plugins.clear();
-        for(auto p : track->pluginList)
+        // Cached editors and pending state snapshots refer to plugins in the Edit, so they have to go first
+        if(auto behaviour = dynamic_cast<ExtendedUIBehaviour*>(&edit->engine.getUIBehaviour()))
         {
-            auto button = plugins.add(std::make_unique<PluginComponent>(p));
-            addAndMakeVisible(button);
+            behaviour->getEditorCache().clear();
+            behaviour->getStateTracker().clear();
         }
-        resized();
     }
 
-    tracktion_engine::Edit& edit;
-    tracktion_engine::Track::Ptr track;
-    juce::TextButton addPluginButton {"+"};
-    juce::OwnedArray<PluginComponent> plugins;
-
-    bool needsUpdate = false; //async update flag
+    std::unique_ptr<tracktion_engine::Edit> edit;
+    PluginMenuCache pluginMenu;
+    PluginInstancePool pluginPool;
+    AsyncPluginLoader pluginLoader;
+    StreamingAudioLoader audioFileLoader;
+    HeadroomSweep headroomSweep;
+    LiveLatencyGuard liveGuard;
+    TrackFreezer freezer;
+    BufferSizeTuner bufferTuner;
+    AutomationRecorder automationRecorder;
+    MidiInputRouter midiRouter;
 };
 //==========================================================================================
 class MainComponent : public juce::Component, 
                       private juce::ChangeListener
 {
 public:
-    MainComponent()
+    MainComponent(StartupTimer& timer)
+      :  startupTimer(timer)
     {
+        // Only what's needed to draw the window is built here. The engine, device and Edit
+        // follow once the window has been painted; see startEngine().
         addAndMakeVisible(&playStopButton);
-        playStopButton.onClick = [this](){togglePlay(edit);};
+        playStopButton.onClick = [this](){togglePlay(getEdit());};
         addAndMakeVisible(&sfLoadButton);
         sfLoadButton.onClick   = [this](){loadSoundFile();};
         addAndMakeVisible(&pluginAddButton);
         pluginAddButton.onClick = [this](){launchPluginList();};
         pluginAddButton.setHelpText("Scan Plugins for KnownPluginList");
+        addAndMakeVisible(&rescanButton);
+        rescanButton.onClick = [this](){rescanChangedPlugins();};
+        rescanButton.setTooltip("Scan plugins that were added or changed since the last scan");
 
-        pluginList = std::make_unique<TrackPluginListComponent>(edit);
-        addAndMakeVisible(pluginList.get());
+        addAndMakeVisible(&liveButton);
+        liveButton.setTooltip("Bypass the highest-latency plugins on any track whose chain goes over the latency budget");
+        liveButton.onClick = [this](){session->liveGuard.setLiveMode(liveButton.getToggleState());};
+        addAndMakeVisible(&latencyBudgetSlider);
+        latencyBudgetSlider.setSliderStyle(juce::Slider::LinearBar);
+        latencyBudgetSlider.setRange(0.0, 100.0, 0.5);
+        latencyBudgetSlider.setTextValueSuffix(" ms budget");
+        latencyBudgetSlider.setValue(10.0, juce::dontSendNotification);
+        latencyBudgetSlider.onValueChange = [this](){session->liveGuard.setBudgetMs(latencyBudgetSlider.getValue());};
 
-        edit.getTransport().addChangeListener(this);
-        
+        addAndMakeVisible(&saveButton);
+        saveButton.onClick = [this](){saveSession();};
+        saveButton.setTooltip("Save the session in the binary session format");
+        addAndMakeVisible(&openButton);
+        openButton.onClick = [this](){openSession();};
+        addAndMakeVisible(&sandboxButton);
+        sandboxButton.setTooltip("Host external plugins added from now on in a separate process, so a crash can't take down the host");
+        sandboxButton.onClick = [this](){PluginSandbox::setEnabled(sandboxButton.getToggleState());};
+        if(! PluginSandbox::isSupported)
+        {
+            sandboxButton.setEnabled(false);
+            sandboxButton.setTooltip("Sandboxed plugins are only available on Linux");
+        }
+        addAndMakeVisible(&deviceSettingsButton);
+        deviceSettingsButton.onClick = [this](){showDeviceSettings();};
+        deviceSettingsButton.setTooltip("Choose the audio device, sample rate and buffer size, or find the smallest stable buffer size");
+        addAndMakeVisible(&presetsButton);
+        presetsButton.onClick = [this](){showPresetMenu();};
+        presetsButton.setTooltip("Save track 0's chain as a preset, or add a preset's plugins to it");
+        addAndMakeVisible(&autoWriteButton);
+        autoWriteButton.setTooltip("While playing, record changes to the parameters of track 0's plugins as automation");
+        autoWriteButton.onClick = [this](){session->automationRecorder.setWriteEnabled(autoWriteButton.getToggleState());};
+
+        addAndMakeVisible(&lanesView);
+
+        addAndMakeVisible(&addTrackButton);
+        addTrackButton.onClick = [this](){getEdit().ensureNumberOfAudioTracks(tracktion_engine::getAudioTracks(getEdit()).size() + 1);};
+        addAndMakeVisible(&headroomButton);
+        headroomButton.onClick = [this](){runHeadroomSweep();};
+        headroomButton.setTooltip("Copy track 0 onto more and more tracks and measure the callback load at each step");
+
+        for(int i = 1; i <= juce::SystemStats::getNumCpus(); ++i)
+            threadsBox.addItem(juce::String(i) + (i == 1 ? " thread" : " threads"), i);
+        threadsBox.setTooltip("Worker threads used to process independent tracks in parallel");
+        threadsBox.onChange = [this](){applyThreading();};
+        addAndMakeVisible(&threadsBox);
+        strategyBox.addItemList(EngineThreading::getStrategyNames(), 1);
+        strategyBox.setTooltip("How idle audio worker threads wait for work");
+        strategyBox.onChange = [this](){applyThreading();};
+        addAndMakeVisible(&strategyBox);
+
+        addAndMakeVisible(&healthDumpButton);
+        healthDumpButton.onClick = [this](){dumpCallbackHealth();};
+        healthDumpButton.setTooltip("Save the audio callback statistics as JSON");
+
+        addAndMakeVisible(&poolStatsLabel);
+        addAndMakeVisible(&loadStatusLabel);
+        addAndMakeVisible(&editorStatsLabel);
+
+        for(auto c : getEngineControls())
+            c->setEnabled(false);
+        loadStatusLabel.setText("Starting...", juce::dontSendNotification);
+        startupTimer.mark("Main component built");
+    }
+    ~MainComponent() override
+    {
+        backgroundJobs.removeAllJobs(true, 10000);
+        if(engine != nullptr)
+            getEditorCache().onStatsChanged = nullptr;
+        closeEdit();
+        healthOverlay = nullptr;
+        healthMonitor = nullptr;
+        pluginScanner = nullptr;
+    }
+
+    void paint(juce::Graphics&) override
+    {
+        if(engine != nullptr || startupStarted)
+            return;
+
+        startupStarted = true;
+        startupTimer.mark("First paint");
+        juce::MessageManager::callAsync([sp = SafePointer<MainComponent>(this)](){if(sp != nullptr) sp->startEngine();});
     }
 
     void resized() override
     {
         playStopButton.setBounds(20, 20, 50, 50);
         sfLoadButton.setBounds(80, 20, 50, 50);
-        //pluginAddButton.setBounds(140, 20, 50, 50);
-        pluginList->setBounds(20, 72, 80, 300);
+        pluginAddButton.setBounds(140, 20, 50, 50);
+        rescanButton.setBounds(260, 20, 50, 50);
+        saveButton.setBounds(320, 20, 50, 50);
+        openButton.setBounds(380, 20, 50, 50);
+        sandboxButton.setBounds(440, 20, 90, 24);
+        deviceSettingsButton.setBounds(440, 46, 90, 24);
+        presetsButton.setBounds(540, 20, 90, 24);
+        autoWriteButton.setBounds(540, 46, 90, 24);
+        auto controls = juce::Rectangle<int>(20, 80, 720, 24);
+        addTrackButton.setBounds(controls.removeFromLeft(80));
+        threadsBox.setBounds(controls.removeFromLeft(110).withTrimmedLeft(6));
+        strategyBox.setBounds(controls.removeFromLeft(170).withTrimmedLeft(6));
+        headroomButton.setBounds(controls.removeFromLeft(120).withTrimmedLeft(6));
+        liveButton.setBounds(controls.removeFromLeft(100).withTrimmedLeft(6));
+        latencyBudgetSlider.setBounds(controls.withTrimmedLeft(6));
+        if(waveform != nullptr)
+            waveform->setBounds(20, 110, getWidth() - 380, 72);
+        lanesView.setBounds(20, 190, getWidth() - 40, getHeight() - 230);
+        if(trackLanes != nullptr)
+            trackLanes->setSize(trackLanes->getWidth(), lanesView.getHeight() - lanesView.getScrollBarThickness());
+        healthDumpButton.setBounds(200, 20, 50, 50);
+        poolStatsLabel.setBounds(20, getHeight() - 30, (getWidth() - 40) / 3, 20);
+        loadStatusLabel.setBounds(poolStatsLabel.getBounds().withX(poolStatsLabel.getRight()));
+        editorStatsLabel.setBounds(loadStatusLabel.getBounds().withX(loadStatusLabel.getRight()));
+        if(healthOverlay != nullptr)
+            healthOverlay->setBounds(getLocalBounds().removeFromTop(180).removeFromRight(340).reduced(10));
     }
 private:
-    tracktion_engine::Engine engine { ProjectInfo::projectName, std::make_unique<ExtendedUIBehaviour>(), nullptr };
-    tracktion_engine::Edit   edit   { tracktion_engine::Edit::Options { engine, 
-                                                                        tracktion_engine::createEmptyEdit(engine), 
-                                                                        tracktion_engine::ProjectItemID::createNewID(0)}};
+    StartupTimer& startupTimer;
+    bool startupStarted = false;
 
+    // Created in stages by startEngine(), after the window has been painted
+    std::unique_ptr<tracktion_engine::Engine> engine;
+    std::unique_ptr<PluginScanning::Scanner> pluginScanner;
+    std::unique_ptr<CallbackHealthMonitor> healthMonitor;
+    std::unique_ptr<CallbackHealthComponent> healthOverlay;
+    std::unique_ptr<PresetLibrary> presetLibrary;
+    std::unique_ptr<EditSession> session;
+    juce::ThreadPool backgroundJobs { 1 };
 
     juce::TextButton playStopButton {"Play"}, sfLoadButton {"Load SF"}, pluginAddButton {"Load Plugin"}, addPluginButton {"+"};
-    std::unique_ptr<TrackPluginListComponent> pluginList;
+    juce::TextButton healthDumpButton {"Dump Health"}, rescanButton {"Rescan"};
+    juce::TextButton addTrackButton {"Add Track"}, headroomButton {"Headroom Sweep"};
+    juce::TextButton saveButton {"Save"}, openButton {"Open"}, deviceSettingsButton {"Audio Settings"};
+    juce::TextButton presetsButton {"Presets"};
+    juce::ComboBox threadsBox, strategyBox;
+    juce::ToggleButton liveButton {"Live"}, sandboxButton {"Sandbox"}, autoWriteButton {"Auto Write"};
+    juce::Slider latencyBudgetSlider;
+    juce::Label poolStatsLabel, loadStatusLabel, editorStatsLabel;
+    juce::Viewport lanesView;
+    std::unique_ptr<TrackLanesComponent> trackLanes;
+    std::unique_ptr<WaveformComponent> waveform;
+    juce::Component::SafePointer<juce::DialogWindow> deviceSettingsWindow;
+
+    tracktion_engine::Edit& getEdit()       { return *session->edit; }
+
+    // Everything that needs the engine or an Edit, disabled until they exist
+    std::vector<juce::Component*> getEngineControls()
+    {
+        return { &playStopButton, &sfLoadButton, &pluginAddButton, &rescanButton, &healthDumpButton, &saveButton, &openButton,
+                 &sandboxButton, &deviceSettingsButton, &presetsButton, &autoWriteButton, &addTrackButton, &threadsBox, &strategyBox, &headroomButton, &liveButton, &latencyBudgetSlider };
+    }
+
+    // Each stage runs on its own message loop iteration, so the window stays responsive and
+    // shows what's happening between them
+    void startEngine()
+    {
+        // Registers the plugin formats and restores the known plugin list; the device is opened separately
+        engine = std::make_unique<tracktion_engine::Engine>(ProjectInfo::projectName, std::make_unique<ExtendedUIBehaviour>(),
+                                                            std::make_unique<HostEngineBehaviour>());
+        engine->getPluginManager().createBuiltInType<SandboxedPlugin>();
+        engine->getPluginManager().createBuiltInType<ConvolutionPlugin>();
+        presetLibrary = std::make_unique<PresetLibrary>(engine->getPropertyStorage().getAppPrefsFolder().getChildFile("Presets"));
+        startupTimer.mark("Engine created");
+        runNextStartupStage("Opening audio device...", [this]()
+        {
+            // Has to come before the device, so its callbacks are registered either side of the engine's
+            healthMonitor = std::make_unique<CallbackHealthMonitor>(*engine);
+            engine->getDeviceManager().initialise();
+            startupTimer.mark("Audio device opened");
+
+            healthOverlay = std::make_unique<CallbackHealthComponent>(*healthMonitor);
+            addAndMakeVisible(healthOverlay.get());
+            runNextStartupStage("Creating Edit...", [this](){createInitialEdit();});
+        });
+    }
+    void createInitialEdit()
+    {
+        auto& behaviour = dynamic_cast<HostEngineBehaviour&>(engine->getEngineBehaviour());
+        threadsBox.setSelectedId(behaviour.numAudioThreads.load(), juce::dontSendNotification);
+        strategyBox.setSelectedItemIndex(tracktion_engine::EditPlaybackContext::getThreadPoolStrategy(), juce::dontSendNotification);
+        sandboxButton.setToggleState(PluginSandbox::isEnabled(), juce::dontSendNotification);
+
+        auto& editorCache = getEditorCache();
+        if(auto settings = tracktion_engine::getApplicationSettings())
+            editorCache.setMemoryBudget((size_t) settings->getIntValue("editorCacheMB", 256) * 1024 * 1024);
+        editorCache.onStatsChanged = [this](const EditorCache::Stats& st)
+        {
+            auto text = "Editors: " + juce::String(st.numCached) + " warm ("
+                          + juce::String((double) st.estimatedBytes / (1024.0 * 1024.0), 1) + " of "
+                          + juce::String((int) (st.budgetBytes / (1024 * 1024))) + " MB est.)";
+            if(st.lastOpened.isNotEmpty())
+                text << ", " << st.lastOpened << " opened in " << juce::String(st.lastOpenMs, 1) << " ms"
+                     << (st.lastOpenWasWarm ? " (warm)" : " (cold)");
+            editorStatsLabel.setText(text, juce::dontSendNotification);
+        };
+
+        setEdit(std::make_unique<tracktion_engine::Edit>(tracktion_engine::Edit::Options { *engine, 
+                                                                                          tracktion_engine::createEmptyEdit(*engine), 
+                                                                                          tracktion_engine::ProjectItemID::createNewID(0)}));
+        for(auto c : getEngineControls())
+            c->setEnabled(true);
+        startupTimer.mark("Ready to play");
+        loadStatusLabel.setText("Window painted in " + juce::String(startupTimer.getTimeOf("First paint"), 0) + " ms, ready to play in "
+                                  + juce::String(startupTimer.getTimeOf("Ready to play"), 0) + " ms",
+                                juce::dontSendNotification);
+
+        // Nothing below is needed to play, so it comes last
+        runNextStartupStage({}, [this]()
+        {
+            pluginScanner = std::make_unique<PluginScanning::Scanner>(*engine);
+            startupTimer.mark("Plugin scan cache loaded");
+            backgroundJobs.addJob([this]()
+            {
+                cleanUpTemporaryFiles();
+                juce::MessageManager::callAsync([sp = SafePointer<MainComponent>(this)]()
+                {
+                    if(sp == nullptr)
+                        return;
+                    sp->startupTimer.mark("Temporary files cleaned up");
+                    sp->loadStatusLabel.setTooltip(sp->startupTimer.toText());
+                    juce::Logger::writeToLog(sp->startupTimer.toText());
+                });
+            });
+        });
+    }
+    void runNextStartupStage(const juce::String& status, std::function<void()> stage)
+    {
+        if(status.isNotEmpty())
+            loadStatusLabel.setText(status, juce::dontSendNotification);
+        juce::MessageManager::callAsync([sp = SafePointer<MainComponent>(this), stage]()
+        {
+            if(sp != nullptr)
+                stage();
+        });
+    }
+    // Runs on backgroundJobs. Removes what earlier runs left behind if they didn't exit cleanly.
+    void cleanUpTemporaryFiles()
+    {
+        engine->getTemporaryFileManager().cleanUp();
+
+        const auto staleBefore = juce::Time::getCurrentTime() - juce::RelativeTime::days(1);
+        auto removeStale = [staleBefore](const juce::File& dir, const juce::String& pattern)
+        {
+            for(auto& f : dir.findChildFiles(juce::File::findFiles, false, pattern))
+                if(f.getLastModificationTime() < staleBefore)
+                    f.deleteFile();
+        };
+        removeStale(engine->getTemporaryFileManager().getTempDirectory().getChildFile("Freeze"), "*.wav");
+        removeStale(juce::File::getSpecialLocation(juce::File::tempDirectory), "*.sandbox");
+    }
+
+    // Tears down everything that refers to the current Edit, then the Edit itself
+    void closeEdit()
+    {
+        if(session == nullptr)
+            return;
+
+        session->edit->getTransport().removeChangeListener(this);
+        // Its auto-tune belongs to the session
+        if(deviceSettingsWindow != nullptr)
+            delete deviceSettingsWindow.getComponent();
+        lanesView.setViewedComponent(nullptr, false);
+        trackLanes = nullptr;
+        waveform = nullptr;
+        session = nullptr;
+        // The guard re-enables its plugins as it goes, without telling anyone
+        liveButton.setButtonText("Live");
+    }
+
+    void setEdit(std::unique_ptr<tracktion_engine::Edit> newEdit)
+    {
+        closeEdit();
+        session = std::make_unique<EditSession>(std::move(newEdit), *healthMonitor);
+        auto& edit = getEdit();
+        EngineThreading::restore(edit);
+
+        trackLanes = std::make_unique<TrackLanesComponent>(edit, session->pluginMenu, session->pluginLoader, 
+                                                           session->pluginPool, session->audioFileLoader, session->freezer);
+        lanesView.setViewedComponent(trackLanes.get(), false);
+        waveform = std::make_unique<WaveformComponent>(*EngineHelpers::getOrInsertAudioTrackAt(edit, 0));
+        addAndMakeVisible(waveform.get());
+
+        session->audioFileLoader.onStatusChanged = [this](const juce::String& status){loadStatusLabel.setText(status, juce::dontSendNotification);};
+        session->freezer.onStatusChanged = [this](const juce::String& status){loadStatusLabel.setText(status, juce::dontSendNotification);};
+        session->pluginPool.onStatsChanged = [this](const PluginInstancePool::Stats& st)
+        {
+            poolStatsLabel.setText("Plugin pool: " + juce::String(st.size) + " warm, "
+                                     + juce::String(st.hits) + " hits, " + juce::String(st.misses) + " misses, "
+                                     + juce::String(st.evictions) + " evicted ("
+                                     + juce::String((double) st.estimatedBytes / (1024.0 * 1024.0), 1) + " MB est.)",
+                                   juce::dontSendNotification);
+        };
+
+        session->liveGuard.onChanged = [&button = liveButton](int n)
+        {
+            button.setButtonText(n > 0 ? "Live (" + juce::String(n) + " off)" : juce::String("Live"));
+        };
+        session->liveGuard.setBudgetMs(latencyBudgetSlider.getValue());
+        session->liveGuard.setLiveMode(liveButton.getToggleState());
+        session->automationRecorder.onPassFinished = [this](const AutomationRecorder::PassStats& st)
+        {
+            loadStatusLabel.setText("Automation: " + juce::String(st.rawEvents) + " moves on " + juce::String(st.numParameters)
+                                      + " parameters kept as " + juce::String(st.keptPoints) + " points, "
+                                      + juce::File::descriptionOfSizeInBytes((juce::int64) st.getBytesPerMinute()) + " per minute"
+                                      + (st.droppedEvents > 0 ? ", " + juce::String(st.droppedEvents) + " dropped" : juce::String()),
+                                    juce::dontSendNotification);
+        };
+        session->automationRecorder.setWriteEnabled(autoWriteButton.getToggleState());
+
+        edit.getTransport().addChangeListener(this);
+        changeListenerCallback(nullptr);
+        headroomButton.setEnabled(true);
+        resized();
+    }
+
+    void saveSession()
+    {
+        auto fc = std::make_shared<juce::FileChooser> ("Save session...",
+                                                       engine->getPropertyStorage().getDefaultLoadSaveDirectory("session"),
+                                                       juce::String("*") + BinarySession::fileExtension);
+
+        fc->launchAsync (juce::FileBrowserComponent::saveMode + juce::FileBrowserComponent::canSelectFiles
+                           + juce::FileBrowserComponent::warnAboutOverwriting,
+                         [fc, this] (const juce::FileChooser&)
+                         {
+                             auto f = fc->getResult().withFileExtension (BinarySession::fileExtension);
+
+                             if (fc->getResult() == juce::File())
+                                 return;
+
+                             const auto start = juce::Time::getMillisecondCounterHiRes();
+                             const bool ok = BinarySession::save (getEdit(), f, [this] (juce::ValueTree& tree)
+                                                                  {
+                                                                      session->liveGuard.restoreInTree (tree);
+                                                                      session->freezer.restoreInTree (tree);
+                                                                  });
+                             const auto ms = juce::Time::getMillisecondCounterHiRes() - start;
+
+                             engine->getPropertyStorage().setDefaultLoadSaveDirectory ("session", f.getParentDirectory());
+                             loadStatusLabel.setText (ok ? "Saved " + f.getFileName() + " in " + juce::String (ms, 1) + " ms"
+                                                         : "Couldn't save " + f.getFileName(),
+                                                      juce::dontSendNotification);
+                         });
+    }
+
+    void openSession()
+    {
+        auto fc = std::make_shared<juce::FileChooser> ("Open session...",
+                                                       engine->getPropertyStorage().getDefaultLoadSaveDirectory("session"),
+                                                       juce::String("*") + BinarySession::fileExtension);
+
+        fc->launchAsync (juce::FileBrowserComponent::openMode + juce::FileBrowserComponent::canSelectFiles,
+                         [fc, this] (const juce::FileChooser&)
+                         {
+                             auto f = fc->getResult();
+
+                             if (! f.existsAsFile())
+                                 return;
+
+                             juce::String error;
+                             const auto start = juce::Time::getMillisecondCounterHiRes();
+                             auto loaded = BinarySession::load (*engine, f, error);
+                             const auto ms = juce::Time::getMillisecondCounterHiRes() - start;
+
+                             if (loaded == nullptr)
+                             {
+                                 loadStatusLabel.setText (error, juce::dontSendNotification);
+                                 return;
+                             }
+
+                             engine->getPropertyStorage().setDefaultLoadSaveDirectory ("session", f.getParentDirectory());
+                             setEdit (std::move (loaded));
+                             loadStatusLabel.setText ("Opened " + f.getFileName() + " in " + juce::String (ms, 1) + " ms",
+                                                      juce::dontSendNotification);
+                         });
+    }
+
+    EditorCache& getEditorCache()
+    {
+        return dynamic_cast<ExtendedUIBehaviour&>(engine->getUIBehaviour()).getEditorCache();
+    }
 
     void changeListenerCallback(juce::ChangeBroadcaster*) override
     {
-        playStopButton.setButtonText(edit.getTransport().isPlaying() ? "Pause" : "Play");
+        playStopButton.setButtonText(getEdit().getTransport().isPlaying() ? "Pause" : "Play");
     }
 
     void togglePlay (tracktion_engine::Edit& edit)
@@ -232,11 +813,127 @@ private:
                                {    
                                     if(file != juce::File())
                                     {
-                                        auto clip = EngineHelpers::loadAudioFileAsClip(edit, file);
-                                        EngineHelpers::loopAroundClip (*clip);
+                                        session->audioFileLoader.loadAndLoop(*EngineHelpers::getOrInsertAudioTrackAt(getEdit(), 0), file);
                                     }
                                };
-        EngineHelpers::browseForAudioFile(engine, loadFileToTrack);
+        EngineHelpers::browseForAudioFile(*engine, loadFileToTrack);
+    }
+    void applyThreading()
+    {
+        EngineThreading::apply(getEdit(), threadsBox.getSelectedId(), strategyBox.getSelectedItemIndex());
+    }
+    void runHeadroomSweep()
+    {
+        headroomButton.setEnabled(false);
+        session->headroomSweep.start({1, 2, 4, 8, 16, 32},
+                            [this](const std::vector<HeadroomSweep::Step>& steps)
+                            {
+                                headroomButton.setEnabled(true);
+                                auto report = HeadroomSweep::toText(steps, threadsBox.getSelectedId(), strategyBox.getText());
+                                juce::Logger::writeToLog(report);
+                                juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::NoIcon, "Headroom Sweep", report);
+                            });
+    }
+    void showPresetMenu()
+    {
+        juce::PopupMenu loadMenu;
+        for(auto& name : presetLibrary->getPresetNames())
+            loadMenu.addItem(name, [this, name](){loadPreset(name);});
+
+        juce::PopupMenu m;
+        m.addItem("Save Track 0 Chain...", [this](){savePreset();});
+        m.addSubMenu("Add To Track 0", loadMenu, loadMenu.getNumItems() > 0);
+        m.addSeparator();
+        m.addItem("Storage Stats", [this]()
+        {
+            auto stats = presetLibrary->getStorageStats();
+            loadStatusLabel.setText(juce::String(stats.numPresets) + " presets, " + juce::String(stats.numBlobs) + " blobs: "
+                                      + juce::File::descriptionOfSizeInBytes(stats.storedBytes) + " stored for "
+                                      + juce::File::descriptionOfSizeInBytes(stats.logicalBytes) + " of presets ("
+                                      + juce::String(stats.getSavedFraction() * 100.0, 1) + "% saved)",
+                                    juce::dontSendNotification);
+        });
+        m.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&presetsButton));
+    }
+    void savePreset()
+    {
+        auto fc = std::make_shared<juce::FileChooser>("Save chain preset...", presetLibrary->getRoot(),
+                                                      juce::String("*") + PresetLibrary::fileExtension);
+
+        fc->launchAsync(juce::FileBrowserComponent::saveMode + juce::FileBrowserComponent::canSelectFiles,
+                        [fc, this](const juce::FileChooser&)
+                        {
+                            // Presets always go in the library, whichever folder was picked
+                            auto name = fc->getResult().getFileNameWithoutExtension();
+                            if(name.isEmpty())
+                                return;
+
+                            const auto start = juce::Time::getMillisecondCounterHiRes();
+                            const bool ok = presetLibrary->saveChain(name, *EngineHelpers::getOrInsertAudioTrackAt(getEdit(), 0));
+                            const auto ms = juce::Time::getMillisecondCounterHiRes() - start;
+                            loadStatusLabel.setText(ok ? "Saved preset " + name + " in " + juce::String(ms, 1) + " ms"
+                                                       : "Couldn't save preset " + name,
+                                                    juce::dontSendNotification);
+                        });
+    }
+    void loadPreset(const juce::String& name)
+    {
+        PresetLibrary::LoadStats stats;
+        if(! presetLibrary->loadChain(name, *EngineHelpers::getOrInsertAudioTrackAt(getEdit(), 0), stats))
+        {
+            loadStatusLabel.setText("Couldn't load preset " + name, juce::dontSendNotification);
+            return;
+        }
+        loadStatusLabel.setText("Loaded " + name + " in " + juce::String(stats.ms, 1) + " ms: "
+                                  + juce::String(stats.blobsFromCache) + "/" + juce::String(stats.numBlobs) + " blobs cached, "
+                                  + juce::File::descriptionOfSizeInBytes(stats.bytesRead) + " read",
+                                juce::dontSendNotification);
+    }
+    void showDeviceSettings()
+    {
+        if(deviceSettingsWindow != nullptr)
+        {
+            deviceSettingsWindow->toFront(true);
+            return;
+        }
+
+        juce::DialogWindow::LaunchOptions o;
+        o.dialogTitle                   = TRANS("Audio Settings");
+        o.dialogBackgroundColour        = getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId);
+        o.escapeKeyTriggersCloseButton  = true;
+        o.useNativeTitleBar             = true;
+        o.resizable                     = true;
+        o.content.setOwned(new DeviceSettingsComponent(*engine, session->bufferTuner));
+        deviceSettingsWindow = o.launchAsync();
+    }
+    void dumpCallbackHealth()
+    {
+        auto fc = std::make_shared<juce::FileChooser> ("Save callback statistics...",
+                                                       juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                                                           .getChildFile ("CallbackHealth.json"),
+                                                       "*.json");
+
+        fc->launchAsync (juce::FileBrowserComponent::saveMode + juce::FileBrowserComponent::canSelectFiles
+                           + juce::FileBrowserComponent::warnAboutOverwriting,
+                         [fc, this] (const juce::FileChooser&)
+                         {
+                             auto f = fc->getResult();
+
+                             if (f != juce::File())
+                                 healthMonitor->writeJSON (f.withFileExtension ("json"));
+                         });
+    }
+    void rescanChangedPlugins()
+    {
+        rescanButton.setEnabled(false);
+        pluginScanner->rescanChanged([sp = juce::Component::SafePointer<MainComponent>(this)](int numScanned)
+                                    {
+                                        if (sp != nullptr)
+                                        {
+                                            sp->rescanButton.setEnabled(true);
+                                            sp->rescanButton.setTooltip(juce::String(numScanned) + " binaries scanned on the last rescan");
+                                        }
+                                    });
     }
     void launchPluginList()
     {
@@ -247,11 +944,12 @@ private:
         o.useNativeTitleBar             = true;
         o.resizable                     = true;
         o.useBottomRightCornerResizer   = true;
-        auto v = new juce::PluginListComponent (engine.getPluginManager().pluginFormatManager,
-                                                engine.getPluginManager().knownPluginList,
-                                                engine.getTemporaryFileManager().getTempFile ("PluginScanDeadMansPedal"),
+        auto v = new juce::PluginListComponent (engine->getPluginManager().pluginFormatManager,
+                                                engine->getPluginManager().knownPluginList,
+                                                engine->getTemporaryFileManager().getTempFile ("PluginScanDeadMansPedal"),
                                                 tracktion_engine::getApplicationSettings());
 
+        v->setNumberOfThreadsForScanning (juce::SystemStats::getNumCpus());
         v->setSize (800, 600);
         o.content.setOwned (v);
         o.launchAsync();
@@ -269,9 +967,25 @@ public:
     const juce::String getApplicationName() override       { return "PluginHostingDemo"; }
     const juce::String getApplicationVersion() override    { return "1.0.0"; }
 
-    void initialise (const juce::String&) override
+    void initialise (const juce::String& commandLine) override
     {
-        mainWindow.reset (new MainWindow ("Plugin Host", new MainComponent, *this));
+        // The plugin scanner relaunches this executable to probe each plugin binary
+        if (PluginScanning::performScanInChildProcess (commandLine))
+        {
+            quit();
+            return;
+        }
+
+        // Sandboxed plugins run in a copy of this executable
+        if (PluginSandbox::performInChildProcess (commandLine))
+        {
+            quit();
+            return;
+        }
+
+        startupTimer.mark ("JUCE initialised");
+        mainWindow.reset (new MainWindow ("Plugin Host", new MainComponent (startupTimer), *this));
+        startupTimer.mark ("Window shown");
     }
 
     void shutdown() override                         { mainWindow = nullptr; }
@@ -308,6 +1022,7 @@ private:
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainWindow)
     };
 
+    StartupTimer startupTimer;
     std::unique_ptr<MainWindow> mainWindow;
 };
 
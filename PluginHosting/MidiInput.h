@@ -0,0 +1,125 @@
+#pragma once
+
+//==============================================================================
+// Routes every MIDI input device to track 0, so instruments in its chain can be played live.
+//
+// The inputs are enabled with end-to-end monitoring, which sends what arrives straight through
+// the track's plugins without needing to record. tracktion stamps each message as it arrives
+// and places it at the matching sample in the next audio block, rather than at the block's start,
+// so timing within a block survives. The routing is redone when MIDI devices come or go.
+class MidiInputRouter : private juce::ChangeListener
+{
+public:
+    MidiInputRouter (tracktion_engine::Edit& e) : edit (e)
+    {
+        edit.engine.getDeviceManager().addChangeListener (this);
+        route();
+    }
+
+    ~MidiInputRouter() override
+    {
+        edit.engine.getDeviceManager().removeChangeListener (this);
+    }
+
+    void route()
+    {
+        auto& dm = edit.engine.getDeviceManager();
+        routedDevices.clear();
+
+        for (int i = 0; i < dm.getNumMidiInDevices(); ++i)
+        {
+            if (auto input = dm.getMidiInDevice (i))
+            {
+                input->setEndToEndEnabled (true);
+                input->setEnabled (true);
+                routedDevices.add (input->getName());
+            }
+        }
+
+        edit.getTransport().ensureContextAllocated();
+
+        if (auto track = EngineHelpers::getOrInsertAudioTrackAt (edit, 0))
+            for (auto instance : edit.getAllInputDevices())
+                if (instance->getInputDevice().getDeviceType() == tracktion_engine::InputDevice::physicalMidiDevice)
+                    instance->setTargetTrack (*track, 0, true);
+
+        edit.restartPlayback();
+    }
+
+    const juce::StringArray& getRoutedDevices() const   { return routedDevices; }
+
+private:
+    tracktion_engine::Edit& edit;
+    juce::StringArray routedDevices;
+
+    // The device manager also broadcasts audio setup changes, which don't need the graph rebuilt
+    void changeListenerCallback (juce::ChangeBroadcaster*) override
+    {
+        auto& dm = edit.engine.getDeviceManager();
+        juce::StringArray devices;
+
+        for (int i = 0; i < dm.getNumMidiInDevices(); ++i)
+            if (auto input = dm.getMidiInDevice (i))
+                devices.add (input->getName());
+
+        if (devices != routedDevices)
+            route();
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (MidiInputRouter)
+};
+
+//==============================================================================
+// Outputs a single full-scale sample where each note-on lands in the block, and silence
+// otherwise, so the output shows exactly where MIDI events were placed. Used to measure MIDI
+// to audio latency.
+class MidiProbePlugin : public tracktion_engine::Plugin
+{
+public:
+    MidiProbePlugin (tracktion_engine::PluginCreationInfo info) : Plugin (info) {}
+
+    ~MidiProbePlugin() override
+    {
+        notifyListenersOfDeletion();
+    }
+
+    static const char* getPluginName()                      { return NEEDS_TRANS ("MIDI Probe"); }
+    static constexpr const char* xmlTypeName = "midiProbe";
+
+    juce::String getName() override                         { return TRANS ("MIDI Probe"); }
+    juce::String getPluginType() override                   { return xmlTypeName; }
+    juce::String getShortName (int) override                { return "Probe"; }
+    bool takesMidiInput() override                          { return true; }
+    bool takesAudioInput() override                         { return false; }
+    bool producesAudioWhenNoAudioInput() override           { return true; }
+    int getNumOutputChannelsGivenInputs (int) override      { return 2; }
+
+    void initialise (const tracktion_engine::PluginInitialisationInfo&) override {}
+    void deinitialise() override {}
+
+    void applyToBuffer (const tracktion_engine::PluginRenderContext& fc) override
+    {
+        if (fc.destBuffer == nullptr)
+            return;
+
+        fc.destBuffer->clear (fc.bufferStartSample, fc.bufferNumSamples);
+
+        if (fc.bufferForMidiMessages == nullptr)
+            return;
+
+        // Timestamps are seconds from the start of the block
+        for (auto& m : *fc.bufferForMidiMessages)
+        {
+            if (! m.isNoteOn())
+                continue;
+
+            const auto offset = juce::jlimit (0, fc.bufferNumSamples - 1, (int) (m.getTimeStamp() * sampleRate));
+
+            for (int ch = 0; ch < fc.destBuffer->getNumChannels(); ++ch)
+                fc.destBuffer->setSample (ch, fc.bufferStartSample + offset, 1.0f);
+        }
+    }
+
+private:
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiProbePlugin)
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+//==============================================================================
+// Offline (faster than realtime) rendering of an Edit to an audio file.
+//
+// tracktion_engine::Renderer::renderToFile hands its task to UIBehaviour::runTaskWithProgressBar,
+// which is fine in an app but gives us no timing; running the RenderTask ourselves lets the caller
+// decide which thread it runs on and lets us report how much faster than realtime it went.
+// The render graph spreads independent nodes over EngineBehaviour::getNumberOfCPUsToUseForAudio()
+// threads, so that's the knob for multi-core rendering.
+namespace OfflineRender
+{
+    struct Result
+    {
+        bool ok = false;
+        juce::String error;
+        juce::File file;
+        double audioSeconds = 0.0;
+        double wallSeconds  = 0.0;
+
+        double getRealtimeFactor() const    { return wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0; }
+    };
+
+    tracktion_engine::Renderer::Parameters createParameters (tracktion_engine::Edit& edit, const juce::File& destFile,
+                                                             const juce::BigInteger& tracksToDo,
+                                                             double sampleRate, int blockSize)
+    {
+        tracktion_engine::Renderer::Parameters params (edit);
+        params.destFile             = destFile;
+        params.audioFormat          = edit.engine.getAudioFileFormatManager().getWavFormat();
+        params.bitDepth             = 24;
+        params.sampleRateForAudio   = sampleRate;
+        params.blockSizeForAudio    = blockSize;
+        params.time                 = { 0.0, edit.getLength() };
+        params.tracksToDo           = tracksToDo;
+        params.usePlugins           = true;
+        params.useMasterPlugins     = true;
+        params.realTimeRender       = false;
+
+        return params;
+    }
+
+    // Runs the render on the calling thread. Plugins are prepared by the RenderTask constructor,
+    // so this must be called from the message thread; use RenderTask directly with a ThreadPool
+    // if the render itself should happen elsewhere.
+    Result render (const tracktion_engine::Renderer::Parameters& params)
+    {
+        Result result;
+        result.file = params.destFile;
+        result.audioSeconds = params.time.getLength();
+
+        params.destFile.deleteFile();
+
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+
+        {
+            std::atomic<float> progress { 0.0f };
+            tracktion_engine::Renderer::RenderTask task ("Render", params, &progress, nullptr);
+
+            while (task.runJob() == juce::ThreadPoolJob::jobNeedsRunningAgain)
+            {}
+
+            result.error = task.errorMessage;
+        }
+
+        result.wallSeconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+        result.ok = result.error.isEmpty() && params.destFile.existsAsFile();
+
+        if (! result.ok && result.error.isEmpty())
+            result.error = "Render produced no output";
+
+        return result;
+    }
+
+    Result renderEdit (tracktion_engine::Edit& edit, const juce::File& destFile, double sampleRate, int blockSize)
+    {
+        return render (createParameters (edit, destFile,
+                                         tracktion_engine::toBitSet (tracktion_engine::getAllTracks (edit)),
+                                         sampleRate, blockSize));
+    }
+}
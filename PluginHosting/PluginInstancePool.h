@@ -0,0 +1,165 @@
+#pragma once
+
+//==============================================================================
+// Keeps recently removed plugins alive so adding the same one again doesn't re-instantiate it.
+//
+// A released plugin is detached from its track but keeps its AudioPluginInstance (tracktion's
+// PluginCache keeps a plugin around for as long as someone holds a reference to it). Entries are
+// keyed on the plugin type and the device's sample rate and block size, so a pooled instance is
+// only handed back when the graph will prepare it exactly as it was prepared before.
+// Re-inserted plugins keep the settings they had when they were removed.
+//
+// The pool is bounded by instance count and by an estimate of memory use, evicting the least
+// recently used first. A plugin's real heap use can't be measured from outside, so the estimate is
+// the size of its saved state plus a fixed per-instance allowance.
+class PluginInstancePool
+{
+public:
+    struct Stats
+    {
+        int hits = 0, misses = 0, evictions = 0, size = 0;
+        size_t estimatedBytes = 0;
+    };
+
+    PluginInstancePool (tracktion_engine::Edit& e, int maxInstances = 16, size_t maxBytes = 512 * 1024 * 1024)
+        : edit (e), maxSize (maxInstances), maxEstimatedBytes (maxBytes)
+    {
+    }
+
+    // Detaches the plugin from its track and keeps it for re-use
+    void release (tracktion_engine::Plugin::Ptr plugin)
+    {
+        if (plugin == nullptr)
+            return;
+
+        edit.flushPluginStateIfNeeded (*plugin);
+        plugin->windowState->closeWindowExplicitly();
+        plugin->removeFromParent();
+
+        Entry entry { getKey (*plugin), plugin, estimateBytes (*plugin) };
+        stats.estimatedBytes += entry.estimatedBytes;
+        entries.push_front (std::move (entry));
+        trim();
+        sendStats();
+    }
+
+    // Returns a pooled plugin of this type, prepared for the current device settings, or nullptr
+    tracktion_engine::Plugin::Ptr acquire (const juce::PluginDescription& desc, const juce::String& xmlType)
+    {
+        const auto key = getKey (desc, xmlType);
+
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->key == key)
+            {
+                auto plugin = it->plugin;
+                stats.estimatedBytes -= it->estimatedBytes;
+                entries.erase (it);
+                ++stats.hits;
+                sendStats();
+                return plugin;
+            }
+        }
+
+        ++stats.misses;
+        sendStats();
+        return {};
+    }
+
+    // Drops the pool's reference to a plugin that's about to be deleted, if it holds one
+    void forget (tracktion_engine::Plugin& plugin)
+    {
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->plugin.get() == &plugin)
+            {
+                stats.estimatedBytes -= it->estimatedBytes;
+                entries.erase (it);
+                sendStats();
+                return;
+            }
+        }
+    }
+
+    void clear()
+    {
+        entries.clear();
+        stats.estimatedBytes = 0;
+        sendStats();
+    }
+
+    Stats getStats() const
+    {
+        auto s = stats;
+        s.size = (int) entries.size();
+        return s;
+    }
+
+    std::function<void (const Stats&)> onStatsChanged;
+
+private:
+    static constexpr size_t perInstanceAllowance = 4 * 1024 * 1024;
+
+    struct Entry
+    {
+        juce::String key;
+        tracktion_engine::Plugin::Ptr plugin;
+        size_t estimatedBytes = 0;
+    };
+
+    tracktion_engine::Edit& edit;
+    const int maxSize;
+    const size_t maxEstimatedBytes;
+    std::list<Entry> entries; // most recently released first
+    Stats stats;
+
+    juce::String getDeviceKey() const
+    {
+        auto& dm = edit.engine.getDeviceManager();
+        return "@" + juce::String (dm.getSampleRate()) + "/" + juce::String (dm.getBlockSize());
+    }
+
+    juce::String getKey (const juce::PluginDescription& desc, const juce::String& xmlType) const
+    {
+        if (xmlType == tracktion_engine::ExternalPlugin::xmlTypeName)
+            return desc.createIdentifierString() + getDeviceKey();
+
+        return xmlType + getDeviceKey();
+    }
+
+    juce::String getKey (tracktion_engine::Plugin& plugin) const
+    {
+        if (auto external = dynamic_cast<tracktion_engine::ExternalPlugin*> (&plugin))
+            return getKey (external->desc, tracktion_engine::ExternalPlugin::xmlTypeName);
+
+        return getKey ({}, plugin.getPluginType());
+    }
+
+    static size_t estimateBytes (tracktion_engine::Plugin& plugin)
+    {
+        size_t stateBytes = 0;
+
+        for (int i = 0; i < plugin.state.getNumProperties(); ++i)
+            stateBytes += (size_t) plugin.state[plugin.state.getPropertyName (i)].toString().getNumBytesAsUTF8();
+
+        return stateBytes + perInstanceAllowance;
+    }
+
+    void trim()
+    {
+        while (! entries.empty() && ((int) entries.size() > maxSize || stats.estimatedBytes > maxEstimatedBytes))
+        {
+            stats.estimatedBytes -= entries.back().estimatedBytes;
+            entries.pop_back();
+            ++stats.evictions;
+        }
+    }
+
+    void sendStats()
+    {
+        if (onStatsChanged != nullptr)
+            onStatsChanged (getStats());
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PluginInstancePool)
+};
@@ -0,0 +1,877 @@
+#pragma once
+
+#if JUCE_LINUX
+ #include <linux/futex.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+// Hosts an external plugin in a child process, so a plugin that crashes or hangs only takes
+// the child down with it.
+//
+// Host and child share a memory-mapped file. It holds one block of audio and MIDI, a small
+// command slot and a payload area for descriptions and plugin state. Each side owns one counter
+// per direction and only ever bumps its own, so there are no locks: the host writes a block and
+// bumps blockRequest, the child processes the samples in place in the shared memory and sets
+// blockDone to match. Whoever is waiting for a counter sleeps on it rather than spinning, with a
+// futex on the counter itself, which works across processes because the counter is in shared
+// memory. So a block costs two copies (the engine's buffers aren't in the mapping) and a wake-up
+// each way, and neither side uses a core while it waits. Futexes are Linux only, and sleeping in
+// steps instead can take longer than a block, so elsewhere sandboxing is unavailable.
+//
+// If the child doesn't answer in time, the host leaves the audio untouched for that block and
+// doesn't send another until the late answer arrives, so a hung plugin never stalls the audio
+// thread for more than one timeout.
+//
+// The child is this executable relaunched with childProcessOption. It loads the plugin on its
+// message thread and then serves blocks there until it's told to quit or the host goes quiet.
+// The host starts it, waits for it to load and prepares it on a thread of its own, so nothing
+// waits for a slow plugin on the message thread. Sandboxed plugins have no editor.
+namespace PluginSandbox
+{
+    static constexpr const char* childProcessOption = "--plugin-sandbox";
+    static constexpr const char* settingName = "sandboxExternalPlugins";
+    static constexpr const char* testPluginIdentifier = "SandboxTestGain";
+
+    static constexpr int maxChannels = 2, maxBlockSize = 8192, maxMidiEvents = 512;
+    static constexpr int maxPayloadBytes = 8 * 1024 * 1024;
+    static constexpr int loadTimeoutMs = 30000, commandTimeoutMs = 5000, heartbeatTimeoutMs = 10000;
+
+    static_assert (std::atomic<juce::uint32>::is_always_lock_free && std::atomic<juce::int64>::is_always_lock_free,
+                   "The shared block relies on lock-free atomics");
+    static_assert (sizeof (std::atomic<juce::uint32>) == sizeof (juce::uint32), "Counters are waited on as plain words");
+
+   #if JUCE_LINUX
+    static constexpr bool isSupported = true;
+   #else
+    static constexpr bool isSupported = false;
+   #endif
+
+    enum Command : juce::int32
+    {
+        noCommand,
+        loadCommand,
+        prepareCommand,
+        getStateCommand,
+        quitCommand
+    };
+
+    struct MidiEvent
+    {
+        juce::int32 sampleOffset;
+        juce::uint8 size;
+        juce::uint8 data[3];
+    };
+
+    // Placed at the start of the mapped file. The counters are the only fields both sides write;
+    // everything else is written by one side before it bumps its counter.
+    struct SharedBlock
+    {
+        std::atomic<juce::uint32> blockRequest { 0 }, blockDone { 0 };
+        std::atomic<juce::uint32> commandRequest { 0 }, commandDone { 0 };
+        std::atomic<juce::uint32> childBell { 0 }; // bumped with every request, so the child can sleep on one counter
+        std::atomic<juce::int32> loaded { 0 };
+        std::atomic<juce::int64> hostHeartbeat { 0 };
+
+        juce::int32 command = noCommand, commandOk = 0;
+        double sampleRate = 44100.0;
+        juce::int32 blockSize = 512, latencySamples = 0;
+
+        juce::int32 numChannels = 0, numSamples = 0, numMidiEvents = 0;
+        MidiEvent midi[maxMidiEvents];
+        float audio[maxChannels][maxBlockSize];
+
+        juce::int32 payloadSize = 0;
+        char payload[maxPayloadBytes];
+    };
+
+    bool isEnabled()
+    {
+        if (! isSupported)
+            return false;
+
+        if (auto settings = tracktion_engine::getApplicationSettings())
+            return settings->getBoolValue (settingName, false);
+
+        return false;
+    }
+
+    void setEnabled (bool shouldBeEnabled)
+    {
+        if (auto settings = tracktion_engine::getApplicationSettings())
+            settings->setValue (settingName, shouldBeEnabled);
+    }
+
+    // Sleeps until counter no longer holds value, or for timeoutMs at most. It can return early,
+    // so callers check the counter again.
+    void sleepWhile (const std::atomic<juce::uint32>& counter, juce::uint32 value, double timeoutMs)
+    {
+       #if JUCE_LINUX
+        const auto us = (long long) juce::jmax (0.0, timeoutMs * 1000.0);
+        timespec timeout { (time_t) (us / 1000000), (long) (us % 1000000) * 1000L };
+
+        // Not FUTEX_PRIVATE_FLAG, as the other process waits and wakes on the same word
+        syscall (SYS_futex, reinterpret_cast<const juce::uint32*> (&counter), FUTEX_WAIT, value, &timeout, nullptr, 0);
+       #else
+        // Never reached, as nothing is sandboxed without futexes
+        juce::ignoreUnused (counter, value, timeoutMs);
+        jassertfalse;
+       #endif
+    }
+
+    // Bumps a counter and wakes whoever is sleeping on it, in either process
+    void bump (std::atomic<juce::uint32>& counter)
+    {
+        counter.fetch_add (1, std::memory_order_release);
+
+       #if JUCE_LINUX
+        syscall (SYS_futex, reinterpret_cast<juce::uint32*> (&counter), FUTEX_WAKE, std::numeric_limits<int>::max(), nullptr, nullptr, 0);
+       #endif
+    }
+
+    // Sets a counter and wakes whoever is sleeping on it
+    void setAndWake (std::atomic<juce::uint32>& counter, juce::uint32 value)
+    {
+        counter.store (value, std::memory_order_release);
+
+       #if JUCE_LINUX
+        syscall (SYS_futex, reinterpret_cast<juce::uint32*> (&counter), FUTEX_WAKE, std::numeric_limits<int>::max(), nullptr, nullptr, 0);
+       #endif
+    }
+
+    // Waits until the counter reaches target, sleeping in between checks
+    bool waitFor (const std::atomic<juce::uint32>& counter, juce::uint32 target, double timeoutMs)
+    {
+        const auto deadline = juce::Time::getMillisecondCounterHiRes() + timeoutMs;
+
+        for (;;)
+        {
+            const auto value = counter.load (std::memory_order_acquire);
+
+            if (value == target)
+                return true;
+
+            const auto remaining = deadline - juce::Time::getMillisecondCounterHiRes();
+
+            if (remaining <= 0.0)
+                return false;
+
+            sleepWhile (counter, value, remaining);
+        }
+    }
+
+    juce::PluginDescription getTestPluginDescription()
+    {
+        juce::PluginDescription d;
+        d.name = "Sandbox Test Gain";
+        d.fileOrIdentifier = testPluginIdentifier;
+        d.pluginFormatName = "Internal";
+        d.numInputChannels = d.numOutputChannels = 2;
+        return d;
+    }
+
+    //==============================================================================
+    // A trivial gain, so benchmarks measure the transport rather than the plugin
+    class TestGainProcessor : public juce::AudioProcessor
+    {
+    public:
+        TestGainProcessor()
+            : AudioProcessor (BusesProperties().withInput ("Input", juce::AudioChannelSet::stereo())
+                                               .withOutput ("Output", juce::AudioChannelSet::stereo()))
+        {
+        }
+
+        const juce::String getName() const override                        { return "Sandbox Test Gain"; }
+        void prepareToPlay (double, int) override                           {}
+        void releaseResources() override                                    {}
+        void processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&) override   { buffer.applyGain (gain); }
+        double getTailLengthSeconds() const override                        { return 0.0; }
+        bool acceptsMidi() const override                                   { return false; }
+        bool producesMidi() const override                                  { return false; }
+        juce::AudioProcessorEditor* createEditor() override                 { return nullptr; }
+        bool hasEditor() const override                                     { return false; }
+        int getNumPrograms() override                                       { return 1; }
+        int getCurrentProgram() override                                    { return 0; }
+        void setCurrentProgram (int) override                               {}
+        const juce::String getProgramName (int) override                    { return {}; }
+        void changeProgramName (int, const juce::String&) override          {}
+
+        void getStateInformation (juce::MemoryBlock& dest) override
+        {
+            dest.replaceAll (&gain, sizeof (gain));
+        }
+
+        void setStateInformation (const void* data, int size) override
+        {
+            if (size == (int) sizeof (gain))
+                std::memcpy (&gain, data, sizeof (gain));
+        }
+
+    private:
+        float gain = 0.5f;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TestGainProcessor)
+    };
+
+    //==============================================================================
+    // The host's end: owns the shared file and the child process. start() returns straight away;
+    // launching the child, waiting for it to load and preparing it happen on the host's thread.
+    class Host : private juce::Thread,
+                 private juce::Timer,
+                 private juce::AsyncUpdater
+    {
+    public:
+        Host() : juce::Thread ("Plugin Sandbox") {}
+
+        ~Host() override
+        {
+            // The thread's waits notice this within a few milliseconds
+            stopThread (2000);
+
+            if (shared != nullptr)
+            {
+                // A child still busy with a command is killed rather than waited for
+                if (child.isRunning() && shared->commandDone.load() == shared->commandRequest.load())
+                {
+                    shared->command = quitCommand;
+                    shared->commandRequest.fetch_add (1, std::memory_order_release);
+                    bump (shared->childBell);
+                }
+
+                if (! child.waitForProcessToFinish (2000))
+                    child.kill();
+            }
+
+            mapping.reset();
+            file.deleteFile();
+        }
+
+        // Message thread. Launches the child and has it load the plugin, without waiting for either.
+        void start (const juce::PluginDescription& d, const juce::MemoryBlock& pluginState, double sampleRate, int blockSize)
+        {
+            desc = d;
+            initialState = pluginState;
+            prepare (sampleRate, blockSize);
+            startTimer (1000);
+            startThread();
+        }
+
+        // Asks for the plugin to be prepared for new device settings. Blocks go unprocessed until
+        // it has been.
+        void prepare (double sampleRate, int blockSize)
+        {
+            {
+                const juce::ScopedLock sl (settingsLock);
+                wantedSampleRate = sampleRate;
+                wantedBlockSize = juce::jlimit (1, maxBlockSize, blockSize);
+            }
+
+            notify();
+        }
+
+        bool isReady() const                { return ready.load (std::memory_order_acquire); }
+        bool hasFailed() const              { return failed.load(); }
+        int getLatencySamples() const       { return isReady() ? shared->latencySamples : 0; }
+        int getNumTimeouts() const          { return numTimeouts.load(); }
+
+        juce::String getError() const
+        {
+            const juce::ScopedLock sl (errorLock);
+            return error;
+        }
+
+        // Called on the message thread once the plugin is ready to play, and if the sandbox fails
+        std::function<void()> onStatusChanged;
+
+        // Blocks until the plugin is ready or the sandbox has failed. For command-line use.
+        bool waitUntilReady (int timeoutMs)
+        {
+            const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32) timeoutMs;
+
+            while (! isReady() && ! hasFailed())
+            {
+                const auto now = juce::Time::getMillisecondCounter();
+
+                if (now >= deadline)
+                    break;
+
+                statusEvent.wait ((int) (deadline - now));
+            }
+
+            return isReady();
+        }
+
+        // Message thread. Rather than wait behind a load or prepare, this gives up, and the state
+        // the plugin was loaded with stays in place.
+        bool getState (juce::MemoryBlock& dest)
+        {
+            const juce::ScopedTryLock stl (commandLock);
+
+            if (! stl.isLocked() || ! isReady() || ! runCommand (getStateCommand, commandTimeoutMs))
+                return false;
+
+            dest.replaceAll (shared->payload, (size_t) shared->payloadSize);
+            return true;
+        }
+
+        // Audio thread. Sends the samples to the child and sleeps until they come back processed.
+        // Returns false, leaving the buffer as it was, if the child isn't ready or doesn't answer in time.
+        bool process (juce::AudioBuffer<float>& buffer, int startSample, int numSamples, const juce::MidiBuffer& midi, double timeoutMs)
+        {
+            if (! isReady())
+                return false;
+
+            // The answer to a block that timed out has to arrive before the child gets another
+            if (shared->blockDone.load (std::memory_order_acquire) != shared->blockRequest.load (std::memory_order_relaxed))
+                return false;
+
+            const auto numChannels = juce::jmin (buffer.getNumChannels(), maxChannels);
+
+            for (int pos = 0; pos < numSamples; pos += maxBlockSize)
+            {
+                const auto num = juce::jmin (numSamples - pos, maxBlockSize);
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                    std::memcpy (shared->audio[ch], buffer.getReadPointer (ch, startSample + pos), (size_t) num * sizeof (float));
+
+                int numEvents = 0;
+
+                for (const auto m : midi)
+                {
+                    if (m.samplePosition >= pos && m.samplePosition < pos + num && m.numBytes <= 3 && numEvents < maxMidiEvents)
+                    {
+                        auto& e = shared->midi[numEvents++];
+                        e.sampleOffset = m.samplePosition - pos;
+                        e.size = (juce::uint8) m.numBytes;
+                        std::memcpy (e.data, m.data, (size_t) m.numBytes);
+                    }
+                }
+
+                shared->numChannels = numChannels;
+                shared->numSamples = num;
+                shared->numMidiEvents = numEvents;
+
+                const auto target = shared->blockRequest.fetch_add (1, std::memory_order_release) + 1;
+                bump (shared->childBell);
+
+                if (! waitFor (shared->blockDone, target, timeoutMs))
+                {
+                    ++numTimeouts;
+                    return false;
+                }
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                    std::memcpy (buffer.getWritePointer (ch, startSample + pos), shared->audio[ch], (size_t) num * sizeof (float));
+            }
+
+            beat();
+            return true;
+        }
+
+    private:
+        juce::PluginDescription desc;
+        juce::MemoryBlock initialState;
+        juce::File file;
+        std::unique_ptr<juce::MemoryMappedFile> mapping;
+        SharedBlock* shared = nullptr;
+        juce::ChildProcess child;
+        std::atomic<bool> launched { false }, ready { false }, failed { false };
+        std::atomic<int> numTimeouts { 0 };
+        juce::WaitableEvent statusEvent;
+
+        juce::CriticalSection settingsLock, errorLock, commandLock;
+        double wantedSampleRate = 44100.0;
+        int wantedBlockSize = 512;
+        juce::String error;
+
+        void run() override
+        {
+            if (! isSupported)
+                return fail ("Sandboxed plugins aren't available on this platform");
+
+            juce::String launchError;
+
+            if (! launch (launchError))
+                return fail (launchError);
+
+            // Loading can take a while, and a plugin that crashes while loading takes the child with it
+            if (! waitForChild (shared->commandDone, shared->commandRequest.load(), loadTimeoutMs) || ! isLoaded())
+                return fail (child.isRunning() ? "The plugin didn't load in the sandbox" : "The sandbox process quit while loading the plugin");
+
+            while (! threadShouldExit())
+            {
+                double sampleRate;
+                int blockSize;
+
+                {
+                    const juce::ScopedLock sl (settingsLock);
+                    sampleRate = wantedSampleRate;
+                    blockSize = wantedBlockSize;
+                }
+
+                if (shared->sampleRate != sampleRate || shared->blockSize != blockSize)
+                {
+                    ready = false;
+                    shared->sampleRate = sampleRate;
+                    shared->blockSize = blockSize;
+
+                    const juce::ScopedLock sl (commandLock);
+
+                    if (! runCommand (prepareCommand, commandTimeoutMs))
+                        return fail ("The sandboxed plugin couldn't be prepared to play");
+                }
+
+                if (! ready.exchange (true))
+                    statusChanged();
+
+                wait (-1);
+            }
+        }
+
+        bool launch (juce::String& launchError)
+        {
+            file = juce::File::createTempFile (".sandbox");
+
+            {
+                juce::FileOutputStream out (file);
+
+                if (! out.openedOk() || ! out.writeRepeatedByte (0, sizeof (SharedBlock)))
+                {
+                    launchError = "Couldn't create " + file.getFullPathName();
+                    return false;
+                }
+            }
+
+            mapping = std::make_unique<juce::MemoryMappedFile> (file, juce::MemoryMappedFile::readWrite);
+
+            if (mapping->getData() == nullptr || mapping->getSize() < sizeof (SharedBlock))
+            {
+                launchError = "Couldn't map " + file.getFullPathName();
+                mapping.reset();
+                return false;
+            }
+
+            shared = new (mapping->getData()) SharedBlock;
+
+            {
+                const juce::ScopedLock sl (settingsLock);
+                shared->sampleRate = wantedSampleRate;
+                shared->blockSize = wantedBlockSize;
+            }
+
+            launched = true;
+            beat();
+
+            juce::XmlElement xml ("SANDBOX");
+            xml.addChildElement (desc.createXml().release());
+            xml.setAttribute ("state", initialState.toBase64Encoding());
+
+            if (! writePayload (xml.toString (juce::XmlElement::TextFormat().singleLine())))
+            {
+                launchError = "Plugin state is too large to send to the sandbox";
+                return false;
+            }
+
+            // Queued before the child exists; it picks the command up as soon as it starts
+            shared->command = loadCommand;
+            shared->commandRequest.fetch_add (1, std::memory_order_release);
+            bump (shared->childBell);
+
+            if (! child.start (juce::StringArray { juce::File::getSpecialLocation (juce::File::currentExecutableFile).getFullPathName(),
+                                                   childProcessOption, file.getFullPathName() }, 0))
+            {
+                launchError = "Couldn't start the sandbox process";
+                return false;
+            }
+
+            return true;
+        }
+
+        bool isLoaded() const               { return shared->loaded.load (std::memory_order_acquire) != 0; }
+
+        void fail (const juce::String& message)
+        {
+            // Nobody is left to tell
+            if (threadShouldExit())
+                return;
+
+            {
+                const juce::ScopedLock sl (errorLock);
+                error = message;
+            }
+
+            ready = false;
+            failed = true;
+            statusChanged();
+        }
+
+        void statusChanged()
+        {
+            statusEvent.signal();
+            triggerAsyncUpdate();
+        }
+
+        void handleAsyncUpdate() override
+        {
+            if (onStatusChanged != nullptr)
+                onStatusChanged();
+        }
+
+        void timerCallback() override
+        {
+            if (launched.load())
+                beat();
+
+            // The thread is done with the child once it's ready, so this is the only place watching it
+            if (isReady() && ! child.isRunning())
+                fail ("The sandbox process quit");
+        }
+
+        void beat()
+        {
+            shared->hostHeartbeat.store (juce::Time::currentTimeMillis(), std::memory_order_relaxed);
+        }
+
+        bool writePayload (const juce::String& text)
+        {
+            const auto size = text.getNumBytesAsUTF8();
+
+            if (size > (size_t) maxPayloadBytes)
+                return false;
+
+            std::memcpy (shared->payload, text.toRawUTF8(), size);
+            shared->payloadSize = (juce::int32) size;
+            return true;
+        }
+
+        // Waits a few milliseconds at a time, giving up early if the child has gone or this is being deleted
+        bool waitForChild (const std::atomic<juce::uint32>& counter, juce::uint32 target, int timeoutMs)
+        {
+            const auto deadline = juce::Time::getMillisecondCounterHiRes() + timeoutMs;
+
+            while (! waitFor (counter, target, 20.0))
+                if (threadShouldExit() || ! child.isRunning() || juce::Time::getMillisecondCounterHiRes() > deadline)
+                    return false;
+
+            return true;
+        }
+
+        // Call with commandLock held
+        bool runCommand (Command c, int timeoutMs)
+        {
+            // An earlier command that timed out has to finish first
+            if (! waitForChild (shared->commandDone, shared->commandRequest.load(), timeoutMs))
+                return false;
+
+            beat();
+            shared->command = c;
+            const auto target = shared->commandRequest.fetch_add (1, std::memory_order_release) + 1;
+            bump (shared->childBell);
+            return waitForChild (shared->commandDone, target, timeoutMs) && shared->commandOk != 0;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE (Host)
+    };
+
+    //==============================================================================
+    // The child's end: loads the plugin and serves blocks until told to stop
+    class Child
+    {
+    public:
+        bool open (const juce::File& f)
+        {
+            mapping = std::make_unique<juce::MemoryMappedFile> (f, juce::MemoryMappedFile::readWrite);
+
+            if (mapping->getData() == nullptr || mapping->getSize() < sizeof (SharedBlock))
+                return false;
+
+            shared = static_cast<SharedBlock*> (mapping->getData());
+            return true;
+        }
+
+        void run()
+        {
+            for (;;)
+            {
+                // Read before looking for work, so a request made after the checks changes it
+                const auto bell = shared->childBell.load (std::memory_order_acquire);
+                const auto commandRequest = shared->commandRequest.load (std::memory_order_acquire);
+
+                if (commandRequest != shared->commandDone.load (std::memory_order_relaxed))
+                {
+                    const auto c = shared->command;
+                    shared->commandOk = c == quitCommand || handleCommand (c) ? 1 : 0;
+                    setAndWake (shared->commandDone, commandRequest);
+
+                    if (c == quitCommand)
+                        return;
+
+                    continue;
+                }
+
+                const auto blockRequest = shared->blockRequest.load (std::memory_order_acquire);
+
+                if (blockRequest != shared->blockDone.load (std::memory_order_relaxed))
+                {
+                    processBlock();
+                    setAndWake (shared->blockDone, blockRequest);
+                    continue;
+                }
+
+                if (juce::Time::currentTimeMillis() - shared->hostHeartbeat.load (std::memory_order_relaxed) > heartbeatTimeoutMs)
+                    return;
+
+                sleepWhile (shared->childBell, bell, 1000.0);
+            }
+        }
+
+    private:
+        std::unique_ptr<juce::MemoryMappedFile> mapping;
+        SharedBlock* shared = nullptr;
+        juce::AudioPluginFormatManager formatManager;
+        std::unique_ptr<juce::AudioProcessor> processor;
+        juce::AudioBuffer<float> spareChannels;
+        std::vector<float*> channels;
+        juce::MidiBuffer midi;
+
+        bool handleCommand (Command c)
+        {
+            switch (c)
+            {
+                case loadCommand:       return load();
+                case prepareCommand:    return prepare();
+                case getStateCommand:   return getState();
+                case noCommand:
+                case quitCommand:
+                default:                return false;
+            }
+        }
+
+        bool load()
+        {
+            auto xml = juce::parseXML (juce::String::fromUTF8 (shared->payload, shared->payloadSize));
+            juce::PluginDescription desc;
+
+            if (xml == nullptr || xml->getFirstChildElement() == nullptr || ! desc.loadFromXml (*xml->getFirstChildElement()))
+                return false;
+
+            if (desc.fileOrIdentifier == testPluginIdentifier)
+            {
+                processor = std::make_unique<TestGainProcessor>();
+            }
+            else
+            {
+                formatManager.addDefaultFormats();
+                juce::String error;
+                processor = formatManager.createPluginInstance (desc, shared->sampleRate, shared->blockSize, error);
+            }
+
+            if (processor == nullptr)
+                return false;
+
+            juce::MemoryBlock state;
+
+            if (state.fromBase64Encoding (xml->getStringAttribute ("state")) && state.getSize() > 0)
+                processor->setStateInformation (state.getData(), (int) state.getSize());
+
+            return prepare();
+        }
+
+        bool prepare()
+        {
+            if (processor == nullptr)
+                return false;
+
+            shared->loaded.store (0, std::memory_order_release);
+            processor->releaseResources();
+            processor->setRateAndBufferSizeDetails (shared->sampleRate, shared->blockSize);
+            processor->prepareToPlay (shared->sampleRate, shared->blockSize);
+
+            // Buses wider than the shared block get scratch channels
+            const auto numProcessorChannels = juce::jmax (processor->getTotalNumInputChannels(), processor->getTotalNumOutputChannels());
+            spareChannels.setSize (juce::jmax (1, numProcessorChannels), maxBlockSize);
+            channels.resize ((size_t) juce::jmax (numProcessorChannels, maxChannels));
+            midi.ensureSize ((size_t) maxMidiEvents * 8);
+
+            shared->latencySamples = processor->getLatencySamples();
+            shared->loaded.store (1, std::memory_order_release);
+            return true;
+        }
+
+        bool getState()
+        {
+            juce::MemoryBlock state;
+            processor->getStateInformation (state);
+
+            if (state.getSize() > (size_t) maxPayloadBytes)
+                return false;
+
+            std::memcpy (shared->payload, state.getData(), state.getSize());
+            shared->payloadSize = (juce::int32) state.getSize();
+            return true;
+        }
+
+        void processBlock()
+        {
+            if (processor == nullptr)
+                return;
+
+            const auto numSamples = juce::jlimit (0, maxBlockSize, (int) shared->numSamples);
+            const auto numShared = juce::jlimit (0, maxChannels, (int) shared->numChannels);
+
+            // Processed in place in the shared memory
+            for (size_t ch = 0; ch < channels.size(); ++ch)
+                channels[ch] = (int) ch < numShared ? shared->audio[ch] : spareChannels.getWritePointer ((int) ch % spareChannels.getNumChannels());
+
+            for (int ch = numShared; ch < spareChannels.getNumChannels(); ++ch)
+                spareChannels.clear (ch, 0, numSamples);
+
+            midi.clear();
+
+            for (int i = 0; i < juce::jmin ((int) shared->numMidiEvents, maxMidiEvents); ++i)
+                midi.addEvent (shared->midi[i].data, shared->midi[i].size, shared->midi[i].sampleOffset);
+
+            juce::AudioBuffer<float> buffer (channels.data(), (int) channels.size(), numSamples);
+            processor->processBlock (buffer, midi);
+        }
+
+        JUCE_DECLARE_NON_COPYABLE (Child)
+    };
+
+    // Serves the plugin described in the shared file until the host says to stop
+    bool runChild (const juce::File& sharedFile)
+    {
+        Child child;
+
+        if (! child.open (sharedFile))
+            return false;
+
+        child.run();
+        return true;
+    }
+
+    // Called from Application::initialise. If this process was launched as a sandbox, it runs
+    // the plugin until the host is done with it and returns true so the caller can quit.
+    bool performInChildProcess (const juce::String& commandLine)
+    {
+        auto args = juce::StringArray::fromTokens (commandLine, true);
+        args.trim();
+        args.removeEmptyStrings();
+        args.unquoteAll();
+
+        const auto optionIndex = args.indexOf (childProcessOption);
+
+        if (optionIndex < 0 || args.size() < optionIndex + 2)
+            return false;
+
+        runChild (juce::File (args[optionIndex + 1]));
+        return true;
+    }
+}
+
+//==============================================================================
+// A tracktion plugin whose processing happens in a PluginSandbox child process.
+// The plugin's description is kept in the state, so Edits reload it sandboxed.
+class SandboxedPlugin : public tracktion_engine::Plugin
+{
+public:
+    SandboxedPlugin (tracktion_engine::PluginCreationInfo info) : Plugin (info)
+    {
+        if (auto xml = juce::parseXML (state[descriptionProperty].toString()))
+            desc.loadFromXml (*xml);
+
+        juce::MemoryBlock pluginState;
+        pluginState.fromBase64Encoding (state[tracktion_engine::IDs::state].toString());
+
+        host.onStatusChanged = [this] { sandboxStatusChanged(); };
+
+        auto& dm = engine.getDeviceManager();
+        host.start (desc, pluginState, dm.getSampleRate(), dm.getBlockSize());
+    }
+
+    ~SandboxedPlugin() override
+    {
+        notifyListenersOfDeletion();
+    }
+
+    static tracktion_engine::Plugin::Ptr create (tracktion_engine::Edit& edit, const juce::PluginDescription& d)
+    {
+        juce::ValueTree v (tracktion_engine::IDs::PLUGIN);
+        v.setProperty (tracktion_engine::IDs::type, xmlTypeName, nullptr);
+        v.setProperty (descriptionProperty, d.createXml()->toString (juce::XmlElement::TextFormat().singleLine()), nullptr);
+        return edit.getPluginCache().getOrCreatePluginFor (v);
+    }
+
+    static const char* getPluginName()                      { return NEEDS_TRANS ("Sandboxed Plugin"); }
+    static constexpr const char* xmlTypeName = "sandboxed";
+    static constexpr const char* descriptionProperty = "description";
+
+    juce::String getName() override                         { return desc.name + (host.hasFailed() ? " (sandbox failed)" : " (sandboxed)"); }
+    juce::String getPluginType() override                   { return xmlTypeName; }
+    bool takesMidiInput() override                          { return desc.isInstrument; }
+    bool isSynth() override                                 { return desc.isInstrument; }
+    bool producesAudioWhenNoAudioInput() override           { return desc.isInstrument; }
+    int getNumOutputChannelsGivenInputs (int) override      { return PluginSandbox::maxChannels; }
+    double getLatencySeconds() override                     { return host.getLatencySamples() / sampleRate; }
+
+    int getNumTimeouts() const                              { return host.getNumTimeouts(); }
+
+    void initialise (const tracktion_engine::PluginInitialisationInfo& info) override
+    {
+        // Doesn't wait; blocks pass through unprocessed until the child has caught up
+        host.prepare (info.sampleRate, info.blockSizeSamples);
+        midi.ensureSize ((size_t) PluginSandbox::maxMidiEvents * 8);
+    }
+
+    void deinitialise() override {}
+
+    void applyToBuffer (const tracktion_engine::PluginRenderContext& fc) override
+    {
+        if (fc.destBuffer == nullptr)
+            return;
+
+        midi.clear();
+
+        if (fc.bufferForMidiMessages != nullptr)
+            for (auto& m : *fc.bufferForMidiMessages)
+                midi.addEvent (m, juce::jlimit (0, fc.bufferNumSamples - 1, (int) (m.getTimeStamp() * sampleRate)));
+
+        // Leave most of the block's time for the rest of the graph
+        const auto timeoutMs = 800.0 * fc.bufferNumSamples / sampleRate;
+
+        // An instrument that didn't answer is silent rather than passing its input through
+        if (! host.process (*fc.destBuffer, fc.bufferStartSample, fc.bufferNumSamples, midi, timeoutMs) && desc.isInstrument)
+            fc.destBuffer->clear (fc.bufferStartSample, fc.bufferNumSamples);
+    }
+
+    void flushPluginStateToValueTree() override
+    {
+        juce::MemoryBlock chunk;
+
+        if (host.getState (chunk))
+            state.setProperty (tracktion_engine::IDs::state, chunk.toBase64Encoding(), nullptr);
+
+        Plugin::flushPluginStateToValueTree();
+    }
+
+private:
+    juce::PluginDescription desc;
+    PluginSandbox::Host host;
+    juce::MidiBuffer midi;
+
+    void sandboxStatusChanged()
+    {
+        if (host.hasFailed())
+        {
+            engine.getUIBehaviour().showWarningAlert (TRANS("Sandboxed Plugin"), desc.name + ": " + host.getError());
+            return;
+        }
+
+        // The latency is only known once the plugin has loaded
+        if (host.getLatencySamples() != 0)
+            edit.restartPlayback();
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SandboxedPlugin)
+};
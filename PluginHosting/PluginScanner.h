@@ -0,0 +1,388 @@
+#pragma once
+
+//==============================================================================
+// Out-of-process, parallel plugin scanning with a persistent cache.
+//
+// Every binary is probed by a child copy of this executable (see performScanInChildProcess),
+// so a plugin that crashes while being scanned only takes the child down with it, and several
+// children can run at once. Results are cached against each binary's path, size and modification
+// time, so a rescan only probes binaries whose stamp changed since the last one.
+namespace PluginScanning
+{
+    static constexpr const char* childProcessOption = "--scan-plugin";
+    static constexpr int childTimeoutMs = 30000;
+
+    // Called from Application::initialise. If this process was launched to scan a binary, it does
+    // so, writes what it found and returns true so the caller can quit.
+    bool performScanInChildProcess (const juce::String& commandLine)
+    {
+        auto args = juce::StringArray::fromTokens (commandLine, true);
+        args.trim();
+        args.removeEmptyStrings();
+        args.unquoteAll();
+
+        const auto optionIndex = args.indexOf (childProcessOption);
+
+        if (optionIndex < 0 || args.size() < optionIndex + 4)
+            return false;
+
+        const auto formatName       = args[optionIndex + 1];
+        const auto fileOrIdentifier = args[optionIndex + 2];
+        const auto outputFile       = juce::File (args[optionIndex + 3]);
+
+        juce::AudioPluginFormatManager formatManager;
+        formatManager.addDefaultFormats();
+
+        juce::XmlElement found ("PLUGINS");
+
+        for (auto format : formatManager.getFormats())
+        {
+            if (format->getName() == formatName)
+            {
+                juce::OwnedArray<juce::PluginDescription> types;
+                format->findAllTypesForFile (types, fileOrIdentifier);
+
+                for (auto d : types)
+                    found.addChildElement (d->createXml().release());
+            }
+        }
+
+        found.writeTo (outputFile);
+        return true;
+    }
+
+    //==============================================================================
+    // Which plugins each binary contained when it was last probed, keyed on the binary's stamp
+    class ScanCache
+    {
+    public:
+        ScanCache (const juce::File& f) : file (f) {}
+
+        struct Stamp
+        {
+            juce::int64 size = 0, modificationTime = 0;
+            bool operator== (const Stamp& o) const  { return size == o.size && modificationTime == o.modificationTime; }
+        };
+
+        // Identifiers that aren't files (e.g. AudioUnits) get a zero stamp and are only probed once
+        static Stamp getStamp (const juce::String& fileOrIdentifier)
+        {
+            juce::File f (fileOrIdentifier);
+
+            if (! juce::File::isAbsolutePath (fileOrIdentifier) || ! f.exists())
+                return {};
+
+            return { f.isDirectory() ? 0 : f.getSize(), f.getLastModificationTime().toMilliseconds() };
+        }
+
+        void load()
+        {
+            const juce::ScopedLock sl (lock);
+            entries.clear();
+
+            if (auto xml = juce::parseXML (file))
+            {
+                for (auto e : xml->getChildWithTagNameIterator ("BINARY"))
+                {
+                    Entry entry;
+                    entry.format = e->getStringAttribute ("format");
+                    entry.stamp  = { e->getStringAttribute ("size").getLargeIntValue(),
+                                     e->getStringAttribute ("mtime").getLargeIntValue() };
+                    entry.failed = e->getBoolAttribute ("failed");
+
+                    for (auto p : e->getChildIterator())
+                    {
+                        juce::PluginDescription d;
+
+                        if (d.loadFromXml (*p))
+                            entry.types.add (d);
+                    }
+
+                    entries[getKey (entry.format, e->getStringAttribute ("path"))] = entry;
+                }
+            }
+        }
+
+        void save() const
+        {
+            juce::XmlElement xml ("PLUGINSCANCACHE");
+
+            {
+                const juce::ScopedLock sl (lock);
+
+                for (auto& [key, entry] : entries)
+                {
+                    auto e = xml.createNewChildElement ("BINARY");
+                    e->setAttribute ("format", entry.format);
+                    e->setAttribute ("path",   key.fromFirstOccurrenceOf ("|", false, false));
+                    e->setAttribute ("size",   juce::String (entry.stamp.size));
+                    e->setAttribute ("mtime",  juce::String (entry.stamp.modificationTime));
+
+                    if (entry.failed)
+                        e->setAttribute ("failed", true);
+
+                    for (auto& d : entry.types)
+                        e->addChildElement (d.createXml().release());
+                }
+            }
+
+            file.getParentDirectory().createDirectory();
+            xml.writeTo (file);
+        }
+
+        bool isUpToDate (const juce::String& format, const juce::String& fileOrIdentifier) const
+        {
+            const juce::ScopedLock sl (lock);
+            auto e = entries.find (getKey (format, fileOrIdentifier));
+
+            return e != entries.end() && e->second.stamp == getStamp (fileOrIdentifier);
+        }
+
+        // Returns false if the binary isn't cached, or has changed since it was
+        bool getTypes (const juce::String& format, const juce::String& fileOrIdentifier,
+                       juce::OwnedArray<juce::PluginDescription>& result, bool& failed) const
+        {
+            const juce::ScopedLock sl (lock);
+            auto e = entries.find (getKey (format, fileOrIdentifier));
+
+            if (e == entries.end() || ! (e->second.stamp == getStamp (fileOrIdentifier)))
+                return false;
+
+            for (auto& d : e->second.types)
+                result.add (new juce::PluginDescription (d));
+
+            failed = e->second.failed;
+            return true;
+        }
+
+        void store (const juce::String& format, const juce::String& fileOrIdentifier,
+                    const juce::OwnedArray<juce::PluginDescription>& types, bool failed)
+        {
+            Entry entry { format, getStamp (fileOrIdentifier), {}, failed };
+
+            for (auto d : types)
+                entry.types.add (*d);
+
+            const juce::ScopedLock sl (lock);
+            entries[getKey (format, fileOrIdentifier)] = entry;
+        }
+
+        // Drops entries for binaries of the given format that are no longer on disk,
+        // returning the plugin types they contained
+        juce::Array<juce::PluginDescription> removeMissing (const juce::String& format, const juce::StringArray& present)
+        {
+            juce::Array<juce::PluginDescription> removed;
+            const juce::ScopedLock sl (lock);
+
+            for (auto it = entries.begin(); it != entries.end();)
+            {
+                if (it->second.format == format
+                     && ! present.contains (it->first.fromFirstOccurrenceOf ("|", false, false)))
+                {
+                    removed.addArray (it->second.types);
+                    it = entries.erase (it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            return removed;
+        }
+
+        void addAllTypesTo (juce::KnownPluginList& list) const
+        {
+            const juce::ScopedLock sl (lock);
+
+            for (auto& [key, entry] : entries)
+                for (auto& d : entry.types)
+                    list.addType (d);
+        }
+
+    private:
+        struct Entry
+        {
+            juce::String format;
+            Stamp stamp;
+            juce::Array<juce::PluginDescription> types;
+            bool failed = false;
+        };
+
+        const juce::File file;
+        juce::CriticalSection lock;
+        std::map<juce::String, Entry> entries;
+
+        static juce::String getKey (const juce::String& format, const juce::String& fileOrIdentifier)
+        {
+            return format + "|" + fileOrIdentifier;
+        }
+    };
+
+    //==============================================================================
+    // Installed on the KnownPluginList, so the PluginListComponent's own scans go through it too
+    class ChildProcessScanner : public juce::KnownPluginList::CustomScanner
+    {
+    public:
+        ChildProcessScanner (ScanCache& c) : cache (c) {}
+
+        bool findPluginTypesFor (juce::AudioPluginFormat& format,
+                                 juce::OwnedArray<juce::PluginDescription>& result,
+                                 const juce::String& fileOrIdentifier) override
+        {
+            bool failed = false;
+
+            if (cache.getTypes (format.getName(), fileOrIdentifier, result, failed))
+                return ! failed;
+
+            juce::TemporaryFile output (".xml");
+            juce::ChildProcess child;
+
+            const juce::StringArray args { juce::File::getSpecialLocation (juce::File::currentExecutableFile).getFullPathName(),
+                                           childProcessOption, format.getName(), fileOrIdentifier,
+                                           output.getFile().getFullPathName() };
+
+            if (! child.start (args, 0))
+                return false;
+
+            if (! child.waitForProcessToFinish (childTimeoutMs))
+                child.kill();
+
+            if (auto xml = juce::parseXML (output.getFile()))
+            {
+                for (auto e : xml->getChildIterator())
+                {
+                    auto d = std::make_unique<juce::PluginDescription>();
+
+                    if (d->loadFromXml (*e))
+                        result.add (d.release());
+                }
+
+                cache.store (format.getName(), fileOrIdentifier, result, false);
+                return true;
+            }
+
+            // The child crashed or hung: remember that, so it isn't retried until the binary changes
+            cache.store (format.getName(), fileOrIdentifier, result, true);
+            return false;
+        }
+
+    private:
+        ScanCache& cache;
+    };
+
+    //==============================================================================
+    // Loads the cache on construction, and rescans binaries that changed since then on request
+    class Scanner : private juce::Thread
+    {
+    public:
+        Scanner (tracktion_engine::Engine& e)
+            : juce::Thread ("Plugin Scanner"),
+              engine (e),
+              cache (e.getPropertyStorage().getAppPrefsFolder().getChildFile ("PluginScanCache.xml"))
+        {
+            auto& list = engine.getPluginManager().knownPluginList;
+
+            cache.load();
+
+            // The engine restores its own copy of the list; only fill it from the cache if that's missing
+            if (list.getNumTypes() == 0)
+                cache.addAllTypesTo (list);
+
+            list.setCustomScanner (std::make_unique<ChildProcessScanner> (cache));
+        }
+
+        ~Scanner() override
+        {
+            stopThread (childTimeoutMs);
+            engine.getPluginManager().knownPluginList.setCustomScanner (nullptr);
+        }
+
+        // Probes every binary that's new or changed since the last scan, removes the ones that
+        // have gone, and calls onFinished on the message thread with the number of binaries probed.
+        // onFinished may run after this object has gone, so it shouldn't capture it.
+        void rescanChanged (std::function<void (int)> onFinished)
+        {
+            if (isThreadRunning())
+                return;
+
+            finishedCallback = std::move (onFinished);
+            searchPaths.clear();
+
+            // The same paths the plugin list dialog scans, including any the user has set there
+            for (auto format : engine.getPluginManager().pluginFormatManager.getFormats())
+                searchPaths[format->getName()] = getSearchPath (*format);
+
+            startThread();
+        }
+
+        bool isScanning() const                     { return isThreadRunning(); }
+        int getNumToScan() const                    { return numToScan.load(); }
+        int getNumScanned() const                   { return numScanned.load(); }
+
+    private:
+        tracktion_engine::Engine& engine;
+        ScanCache cache;
+        std::function<void (int)> finishedCallback;
+        std::map<juce::String, juce::FileSearchPath> searchPaths;
+        std::atomic<int> numToScan { 0 }, numScanned { 0 };
+
+        static juce::FileSearchPath getSearchPath (juce::AudioPluginFormat& format)
+        {
+            if (auto settings = tracktion_engine::getApplicationSettings())
+                return juce::PluginListComponent::getLastSearchPath (*settings, format);
+
+            return format.getDefaultLocationsToSearch();
+        }
+
+        void run() override
+        {
+            auto& pluginManager = engine.getPluginManager();
+            auto& list = pluginManager.knownPluginList;
+            juce::ThreadPool pool (juce::jmax (1, juce::SystemStats::getNumCpus()));
+
+            numToScan = 0;
+            numScanned = 0;
+
+            for (auto format : pluginManager.pluginFormatManager.getFormats())
+            {
+                if (threadShouldExit())
+                    break;
+
+                const auto present = format->searchPathsForPlugins (searchPaths[format->getName()], true, false);
+
+                for (auto& d : cache.removeMissing (format->getName(), present))
+                    list.removeType (d);
+
+                for (auto& fileOrIdentifier : present)
+                {
+                    if (cache.isUpToDate (format->getName(), fileOrIdentifier))
+                        continue;
+
+                    ++numToScan;
+                    pool.addJob ([this, &list, format, fileOrIdentifier]
+                                 {
+                                     if (threadShouldExit())
+                                         return;
+
+                                     for (auto& t : list.getTypes())
+                                         if (t.fileOrIdentifier == fileOrIdentifier)
+                                             list.removeType (t);
+
+                                     juce::OwnedArray<juce::PluginDescription> found;
+                                     list.scanAndAddFile (fileOrIdentifier, false, found, *format);
+                                     ++numScanned;
+                                 });
+                }
+            }
+
+            while (pool.getNumJobs() > 0)
+                wait (20);
+
+            cache.save();
+
+            if (finishedCallback != nullptr)
+                juce::MessageManager::callAsync ([callback = finishedCallback, n = numScanned.load()] { callback (n); });
+        }
+    };
+}
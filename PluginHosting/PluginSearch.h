@@ -0,0 +1,106 @@
+#pragma once
+
+//==============================================================================
+// Type-ahead plugin search, backed by the PluginMenuCache's PluginIndex.
+// Results are kept as menu IDs rather than tree items, so they survive the tree being
+// rebuilt while the search box is open.
+class PluginSearchComponent : public juce::Component,
+                              private juce::ListBoxModel
+{
+public:
+    PluginSearchComponent (PluginMenuCache& cache, std::function<void (int)> onChosen)
+        : pluginMenu (cache), pluginChosen (std::move (onChosen))
+    {
+        addAndMakeVisible (searchBox);
+        searchBox.setTextToShowWhenEmpty ("Search plugins...", juce::Colours::grey);
+        searchBox.onTextChange = [this] { updateResults(); };
+        searchBox.onReturnKey  = [this] { choose (resultsList.getSelectedRow() >= 0 ? resultsList.getSelectedRow() : 0); };
+
+        addAndMakeVisible (resultsList);
+        resultsList.setModel (this);
+
+        addAndMakeVisible (statusLabel);
+        statusLabel.setFont (11.0f);
+
+        setSize (300, 360);
+    }
+
+    void resized() override
+    {
+        auto b = getLocalBounds().reduced (4);
+        searchBox.setBounds (b.removeFromTop (24));
+        statusLabel.setBounds (b.removeFromBottom (16));
+        resultsList.setBounds (b.withTrimmedTop (4));
+    }
+
+    void visibilityChanged() override
+    {
+        if (isShowing())
+            searchBox.grabKeyboardFocus();
+    }
+
+private:
+    static constexpr size_t maxResults = 200;
+
+    PluginMenuCache& pluginMenu;
+    std::function<void (int)> pluginChosen;
+
+    juce::TextEditor searchBox;
+    juce::ListBox resultsList;
+    juce::Label statusLabel;
+    std::vector<int> results;
+
+    void updateResults()
+    {
+        auto& index = pluginMenu.getIndex();
+
+        const auto start = juce::Time::getHighResolutionTicks();
+        results = index.search (searchBox.getText(), maxResults);
+        const auto micros = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1.0e6;
+
+        statusLabel.setText (juce::String ((int) results.size()) + (results.size() == maxResults ? "+" : "")
+                                + " matches in " + juce::String ((int) micros) + " us",
+                             juce::dontSendNotification);
+
+        resultsList.updateContent();
+        resultsList.selectRow (0);
+        resultsList.repaint();
+    }
+
+    void choose (int row)
+    {
+        if (! juce::isPositiveAndBelow (row, (int) results.size()))
+            return;
+
+        // Dismissing the box deletes us, so keep what's needed on the stack
+        const auto id = results[(size_t) row];
+        auto callback = pluginChosen;
+
+        if (auto box = findParentComponentOfClass<juce::CallOutBox>())
+            box->dismiss();
+
+        callback (id);
+    }
+
+    //==============================================================================
+    int getNumRows() override                                   { return (int) results.size(); }
+    void listBoxItemDoubleClicked (int row, const juce::MouseEvent&) override    { choose (row); }
+    void returnKeyPressed (int row) override                    { choose (row); }
+
+    void paintListBoxItem (int row, juce::Graphics& g, int width, int height, bool rowIsSelected) override
+    {
+        if (rowIsSelected)
+            g.fillAll (getLookAndFeel().findColour (juce::TextEditor::highlightColourId));
+
+        if (auto item = pluginMenu.getIndex().findItem (results[(size_t) row]))
+        {
+            g.setColour (juce::Colours::white);
+            g.setFont (14.0f);
+            g.drawText (item->desc.name, 4, 0, width - 8, height, juce::Justification::centredLeft);
+
+            g.setColour (juce::Colours::grey);
+            g.setFont (11.0f);
+            g.drawText (item->desc.manufacturerName, 4, 0, width - 8, height, juce::Justification::centredRight);
+        }
+    }
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+//==============================================================================
+// Coalesces "this plugin might have changed" notifications and keeps plugin state in the Edit
+// up to date, hashing the state on a background thread.
+//
+// markDirty() only records the plugin, so it's cheap enough to call on every window move or
+// editor resize. Once a plugin has had no new notifications for settleMs, its processor is asked
+// for its state on the message thread, a few plugins at a time within snapshotBudgetMs per timer
+// tick. That has to happen there: the instance can be deleted on the message thread at any time
+// (processing turned off, a full re-initialise), and nothing else keeps it alive. The state is
+// then hashed on a background thread. Only when the hash differs from the last one written is the
+// new state put into the plugin's ValueTree, back on the message thread, in the same form
+// ExternalPlugin::flushPluginStateToValueTree uses. The Edit's tree watcher then sees the Edit as
+// changed, so nothing needs to call Edit::pluginChanged.
+// Built-in plugins keep their state in the ValueTree already and are ignored.
+//
+// Hashed snapshots wait in a list until the message thread collects them, rather than being
+// posted as messages, so clear() can drop every plugin reference the tracker holds while the
+// Edit still exists. The last reference to a plugin is never dropped on the background thread.
+class PluginStateTracker : private juce::Timer,
+                           private juce::Thread,
+                           private juce::AsyncUpdater
+{
+public:
+    PluginStateTracker() : juce::Thread ("Plugin State Snapshots")
+    {
+        startThread (0);
+    }
+
+    ~PluginStateTracker() override
+    {
+        stopThread (10000);
+    }
+
+    void markDirty (tracktion_engine::Plugin& plugin)
+    {
+        if (dynamic_cast<tracktion_engine::ExternalPlugin*> (&plugin) == nullptr)
+            return;
+
+        dirty[&plugin] = { &plugin, juce::Time::getMillisecondCounter() };
+
+        if (! isTimerRunning())
+            startTimer (settleMs);
+    }
+
+    // Drops everything pending, waiting for a snapshot that's under way to finish. Call before
+    // the Edit holding the plugins is deleted.
+    void clear()
+    {
+        stopTimer();
+        dirty.clear();
+        writtenHashes.clear(); // item IDs are only unique within an Edit
+
+        {
+            const juce::ScopedLock sl (queueLock);
+            queue.clear();
+        }
+
+        // Once this is held, the thread has put any plugin it was working on into finished
+        const juce::ScopedLock snapshotting (snapshotLock);
+        cancelPendingUpdate();
+
+        const juce::ScopedLock sl (queueLock);
+        finished.clear();
+    }
+
+    // Drops any pending snapshot of a plugin that's about to be deleted. A snapshot being hashed
+    // still finishes, but is written on the message thread, where the plugin is let go of.
+    void forget (tracktion_engine::Plugin& plugin)
+    {
+        dirty.erase (&plugin);
+
+        const juce::ScopedLock sl (queueLock);
+        queue.erase (std::remove_if (queue.begin(), queue.end(), [&] (auto& s) { return s.plugin.get() == &plugin; }), queue.end());
+        finished.erase (std::remove_if (finished.begin(), finished.end(), [&] (auto& s) { return s.plugin.get() == &plugin; }),
+                        finished.end());
+    }
+
+    int getNumSnapshots() const         { return numSnapshots.load(); }
+    int getNumWrites() const            { return numWrites.load(); }
+
+private:
+    static constexpr int settleMs = 500, snapshotBudgetMs = 10;
+
+    struct Pending
+    {
+        tracktion_engine::Plugin::Ptr plugin;
+        juce::uint32 lastMarked = 0;
+    };
+
+    struct Snapshot
+    {
+        tracktion_engine::Plugin::Ptr plugin;
+        juce::MemoryBlock chunk;
+        juce::uint64 hash = 0;
+    };
+
+    // Only touched on the message thread
+    std::map<tracktion_engine::Plugin*, Pending> dirty;
+    std::map<juce::String, juce::uint64> writtenHashes;
+
+    juce::CriticalSection queueLock, snapshotLock;
+    std::deque<Snapshot> queue;
+    std::vector<Snapshot> finished;
+    std::atomic<int> numSnapshots { 0 }, numWrites { 0 };
+
+    void timerCallback() override
+    {
+        const auto now = juce::Time::getMillisecondCounter();
+        const auto tickStart = juce::Time::getMillisecondCounterHiRes();
+
+        for (auto it = dirty.begin(); it != dirty.end();)
+        {
+            // Whatever's left waits for the next tick
+            if (juce::Time::getMillisecondCounterHiRes() - tickStart >= snapshotBudgetMs)
+                break;
+
+            if (now - it->second.lastMarked >= (juce::uint32) settleMs)
+            {
+                auto snapshot = capture (it->second.plugin);
+
+                {
+                    const juce::ScopedLock sl (queueLock);
+                    queue.push_back (std::move (snapshot));
+                }
+
+                it = dirty.erase (it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        if (dirty.empty())
+            stopTimer();
+
+        notify();
+    }
+
+    // Message thread, where the instance can't be deleted while it's being asked
+    Snapshot capture (tracktion_engine::Plugin::Ptr plugin)
+    {
+        juce::MemoryBlock chunk;
+
+        if (auto external = dynamic_cast<tracktion_engine::ExternalPlugin*> (plugin.get()))
+            if (auto pi = external->getAudioPluginInstance())
+                pi->getStateInformation (chunk);
+
+        ++numSnapshots;
+        return { std::move (plugin), std::move (chunk), 0 };
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            for (;;)
+            {
+                const juce::ScopedLock snapshotting (snapshotLock);
+                Snapshot s;
+
+                {
+                    const juce::ScopedLock sl (queueLock);
+
+                    if (queue.empty())
+                        break;
+
+                    s = std::move (queue.front());
+                    queue.pop_front();
+                }
+
+                s.hash = getHash (s.chunk);
+
+                // The plugin goes back to the message thread even if nothing changed,
+                // so the last reference to it is never dropped here
+                {
+                    const juce::ScopedLock sl (queueLock);
+                    finished.push_back (std::move (s));
+                }
+
+                triggerAsyncUpdate();
+            }
+
+            wait (-1);
+        }
+    }
+
+    void handleAsyncUpdate() override
+    {
+        std::vector<Snapshot> toWrite;
+
+        {
+            const juce::ScopedLock sl (queueLock);
+            toWrite.swap (finished);
+        }
+
+        for (auto& s : toWrite)
+            write (*s.plugin, s.chunk, s.hash);
+    }
+
+    void write (tracktion_engine::Plugin& plugin, const juce::MemoryBlock& chunk, juce::uint64 hash)
+    {
+        if (chunk.isEmpty() || ! plugin.state.isValid())
+            return;
+
+        auto& lastHash = writtenHashes[plugin.itemID.toString()];
+
+        if (lastHash == hash)
+            return;
+
+        lastHash = hash;
+        plugin.state.setProperty (tracktion_engine::IDs::state, chunk.toBase64Encoding(), nullptr);
+        ++numWrites;
+    }
+
+    static juce::uint64 getHash (const juce::MemoryBlock& data)
+    {
+        // FNV-1a
+        juce::uint64 hash = 14695981039346656037ull;
+
+        for (size_t i = 0; i < data.getSize(); ++i)
+            hash = (hash ^ (juce::uint8) data[i]) * 1099511628211ull;
+
+        return hash;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PluginStateTracker)
+};
@@ -1,3 +1,7 @@
+#pragma once
+#include "EngineHelpers.h"
+#include "PluginSandbox.h"
+#include "ConvolutionPlugin.h"
 
 //====================Borrowed From Components.cpp in Tracktion's Examples/common
 //
@@ -15,6 +19,7 @@ public:
     void addSubItem (PluginTreeBase* itm)   { subitems.add (itm);       }
     int getNumSubItems()                    { return subitems.size();   }
     PluginTreeBase* getSubItem (int idx)    { return subitems[idx];     }
+    void removeSubItems (int startIdx)      { subitems.removeRange (startIdx, subitems.size() - startIdx); }
     
 private:
     OwnedArray<PluginTreeBase> subitems;
@@ -64,6 +69,9 @@ PluginTreeItem::PluginTreeItem (const String& uniqueId, const String& name,
 
 tracktion_engine::Plugin::Ptr PluginTreeItem::create (tracktion_engine::Edit& ed)
 {
+    if (xmlType == tracktion_engine::ExternalPlugin::xmlTypeName && PluginSandbox::isEnabled())
+        return SandboxedPlugin::create (ed, desc);
+
     return ed.getPluginCache().createNewPlugin (xmlType, desc);
 }
 
@@ -75,11 +83,19 @@ public:
     
     String getUniqueName() const override           { return name; }
 
+    // Rebuild just one part of a root group, so a cached tree can follow changes cheaply
+    void updateExternalPlugins (KnownPluginList::PluginTree&);
+    PluginTreeGroup* getRacksFolder()               { return dynamic_cast<PluginTreeGroup*> (getSubItem (racksFolderIndex)); }
+
     String name;
 
 private:
+    // A root group holds the builtin and rack folders, followed by the external plugins
+    static constexpr int racksFolderIndex = 1, numFixedFolders = 2;
+
     void populateFrom (KnownPluginList::PluginTree&);
     void createBuiltInItems (int& num, tracktion_engine::Plugin::Type);
+    void createRackItems (tracktion_engine::Edit&);
 
     JUCE_LEAK_DETECTOR (PluginTreeGroup)
 };
@@ -98,15 +114,7 @@ PluginTreeGroup::PluginTreeGroup (tracktion_engine::Edit& edit, KnownPluginList:
     {
         auto racksFolder = new PluginTreeGroup (TRANS("Plugin Racks"));
         addSubItem (racksFolder);
-
-        racksFolder->addSubItem (new PluginTreeItem (String (tracktion_engine::RackType::getRackPresetPrefix()) + "-1",
-                                                     TRANS("Create New Empty Rack"),
-                                                     tracktion_engine::RackInstance::xmlTypeName, false, false));
-
-        int i = 0;
-        for (auto rf : edit.getRackList().getTypes())
-            racksFolder->addSubItem (new PluginTreeItem ("RACK__" + String (i++), rf->rackName,
-                                                         tracktion_engine::RackInstance::xmlTypeName, false, false));
+        racksFolder->createRackItems (edit);
     }
 
     populateFrom (tree);
@@ -117,6 +125,24 @@ PluginTreeGroup::PluginTreeGroup (const String& s)  : name (s)
     jassert (name.isNotEmpty());
 }
 
+void PluginTreeGroup::createRackItems (tracktion_engine::Edit& edit)
+{
+    addSubItem (new PluginTreeItem (String (tracktion_engine::RackType::getRackPresetPrefix()) + "-1",
+                                    TRANS("Create New Empty Rack"),
+                                    tracktion_engine::RackInstance::xmlTypeName, false, false));
+
+    int i = 0;
+    for (auto rf : edit.getRackList().getTypes())
+        addSubItem (new PluginTreeItem ("RACK__" + String (i++), rf->rackName,
+                                        tracktion_engine::RackInstance::xmlTypeName, false, false));
+}
+
+void PluginTreeGroup::updateExternalPlugins (KnownPluginList::PluginTree& tree)
+{
+    removeSubItems (numFixedFolders);
+    populateFrom (tree);
+}
+
 void PluginTreeGroup::populateFrom (KnownPluginList::PluginTree& tree)
 {
     for (auto subTree : tree.subFolders)
@@ -149,6 +175,7 @@ void PluginTreeGroup::createBuiltInItems (int& num, tracktion_engine::Plugin::Ty
     addInternalPlugin<tracktion_engine::LevelMeterPlugin> (*this, num);
     addInternalPlugin<tracktion_engine::EqualiserPlugin> (*this, num);
     addInternalPlugin<tracktion_engine::ReverbPlugin> (*this, num);
+    addInternalPlugin<ConvolutionPlugin> (*this, num);
     addInternalPlugin<tracktion_engine::DelayPlugin> (*this, num);
     addInternalPlugin<tracktion_engine::ChorusPlugin> (*this, num);
     addInternalPlugin<tracktion_engine::PhaserPlugin> (*this, num);
@@ -190,74 +217,455 @@ inline std::unique_ptr<juce::KnownPluginList::PluginTree> createPluginTree (trac
 
     return {};
 }
+// Gives every item in a plugin tree a menu ID and makes the tree searchable.
+//
+// IDs are handed out per unique name and never reused, so they can't collide the way
+// String::hashCode() could, and an ID kept across a rebuild still means the same plugin
+// (or nothing, if it has gone). Lookup by ID is an array index.
+//
+// Search matches every whitespace separated word of the query against each item's name,
+// manufacturer, category and format. Words of three or more characters go through a trigram
+// index, so only items sharing the query's rarest trigram are ever looked at.
+class PluginIndex
+{
+public:
+    void rebuild (PluginTreeGroup& root)
+    {
+        std::fill (itemsById.begin(), itemsById.end(), nullptr);
+        std::fill (entryIndexById.begin(), entryIndexById.end(), -1);
+        entries.clear();
+        trigrams.clear();
+
+        addItemsFrom (root);
+    }
+
+    // Adds or re-adds a single item; it keeps the ID it had before under the same unique name
+    void addItem (PluginTreeItem& item)
+    {
+        auto& id = idsByName[item.getUniqueName()];
+
+        if (id == 0)
+        {
+            id = (int) itemsById.size();
+            itemsById.push_back (nullptr);
+            entryIndexById.push_back (-1);
+        }
+
+        removeEntry (id);
+        itemsById[(size_t) id] = &item;
+
+        const auto entryIndex = (int) entries.size();
+        entryIndexById[(size_t) id] = entryIndex;
+        entries.push_back ({ id, (item.desc.name + " " + item.desc.manufacturerName + " "
+                                   + item.desc.category + " " + item.desc.pluginFormatName).toLowerCase() });
+
+        forEachTrigram (entries.back().text, [this, entryIndex] (juce::uint64 t)
+                        {
+                            auto& postings = trigrams[t];
+
+                            if (postings.empty() || postings.back() != entryIndex)
+                                postings.push_back (entryIndex);
+                        });
+    }
+
+    void removeItem (const PluginTreeItem& item)
+    {
+        auto found = idsByName.find (item.getUniqueName());
+
+        if (found != idsByName.end())
+        {
+            removeEntry (found->second);
+            itemsById[(size_t) found->second] = nullptr;
+        }
+    }
+
+    int getIdFor (const PluginTreeItem& item) const
+    {
+        auto found = idsByName.find (item.getUniqueName());
+        return found != idsByName.end() ? found->second : 0;
+    }
+
+    PluginTreeItem* findItem (int id) const
+    {
+        return juce::isPositiveAndBelow (id, (int) itemsById.size()) ? itemsById[(size_t) id] : nullptr;
+    }
+
+    // Returns menu IDs of the matching items, names starting with the query first
+    std::vector<int> search (const String& query, size_t maxResults) const
+    {
+        auto words = juce::StringArray::fromTokens (query.toLowerCase(), false);
+        words.removeEmptyStrings();
+
+        std::vector<int> results;
+
+        if (words.isEmpty())
+            return results;
+
+        auto matchesAllWords = [&words] (const Entry& e)
+        {
+            for (auto& w : words)
+                if (! e.text.contains (w))
+                    return false;
+
+            return true;
+        };
+
+        std::vector<int> startsWithQuery, others;
+        const auto firstWord = words[0];
+
+        auto consider = [&] (const Entry& e)
+        {
+            if (e.id != 0 && matchesAllWords (e))
+                (e.text.startsWith (firstWord) ? startsWithQuery : others).push_back (e.id);
+        };
+
+        if (auto* candidates = findRarestTrigramPostings (words))
+        {
+            for (auto index : *candidates)
+                consider (entries[(size_t) index]);
+        }
+        else
+        {
+            for (auto& e : entries)
+                consider (e);
+        }
+
+        results = std::move (startsWithQuery);
+        results.insert (results.end(), others.begin(), others.end());
+
+        if (results.size() > maxResults)
+            results.resize (maxResults);
+
+        return results;
+    }
+
+private:
+    struct Entry
+    {
+        int id;
+        String text; // lower case name, manufacturer, category and format
+    };
+
+    std::map<String, int> idsByName;
+    std::vector<PluginTreeItem*> itemsById { nullptr }; // ID 0 is "no item", as it is for menus
+    std::vector<int> entryIndexById { -1 };
+    std::vector<Entry> entries;                         // entries of removed items have ID 0
+    std::unordered_map<juce::uint64, std::vector<int>> trigrams;
+
+    static juce::uint64 getTrigram (juce::String::CharPointerType p)
+    {
+        // 21 bits covers any unicode code point
+        const auto c0 = (juce::uint64) p.getAndAdvance();
+        const auto c1 = (juce::uint64) p.getAndAdvance();
+        const auto c2 = (juce::uint64) *p;
+        return (c0 << 42) | (c1 << 21) | c2;
+    }
+
+    template<typename Callback>
+    static void forEachTrigram (const String& text, Callback&& callback)
+    {
+        auto p = text.getCharPointer();
+
+        for (int i = 0, n = text.length() - 2; i < n; ++i)
+        {
+            callback (getTrigram (p));
+            ++p;
+        }
+    }
+
+    void addItemsFrom (PluginTreeGroup& node)
+    {
+        for (int i = 0; i < node.getNumSubItems(); ++i)
+        {
+            if (auto subNode = dynamic_cast<PluginTreeGroup*> (node.getSubItem (i)))
+                addItemsFrom (*subNode);
+            else if (auto item = dynamic_cast<PluginTreeItem*> (node.getSubItem (i)))
+                addItem (*item);
+        }
+    }
+
+    // The entry's trigram postings are left behind, and skipped by search, until the next rebuild
+    void removeEntry (int id)
+    {
+        auto& entryIndex = entryIndexById[(size_t) id];
+
+        if (entryIndex >= 0)
+            entries[(size_t) entryIndex].id = 0;
+
+        entryIndex = -1;
+    }
+
+    // Returns nullptr if the query is too short to use the trigram index
+    const std::vector<int>* findRarestTrigramPostings (const juce::StringArray& words) const
+    {
+        static const std::vector<int> none;
+        const std::vector<int>* rarest = nullptr;
+
+        for (auto& w : words)
+        {
+            forEachTrigram (w, [&] (juce::uint64 t)
+                            {
+                                auto found = trigrams.find (t);
+                                auto* postings = found != trigrams.end() ? &found->second : &none;
+
+                                if (rarest == nullptr || postings->size() < rarest->size())
+                                    rarest = postings;
+                            });
+        }
+
+        return rarest;
+    }
+};
+
 class PluginMenu : public juce::PopupMenu
 {
 public:
     PluginMenu() = default;
 
-    PluginMenu (PluginTreeGroup& node)
+    PluginMenu (PluginTreeGroup& node, const PluginIndex& index)
     {
         for (int i = 0; i < node.getNumSubItems(); ++i)
             if (auto subNode = dynamic_cast<PluginTreeGroup*> (node.getSubItem (i)))
-                addSubMenu (subNode->name, PluginMenu (*subNode), true);
+                addSubMenu (subNode->name, PluginMenu (*subNode, index), true);
 
         for (int i = 0; i < node.getNumSubItems(); ++i)
             if (auto subType = dynamic_cast<PluginTreeItem*> (node.getSubItem (i)))
-                addItem (subType->getUniqueName().hashCode(), subType->desc.name, true, false);
+                addItem (index.getIdFor (*subType), subType->desc.name, true, false);
     }
 
-    static PluginTreeItem* findType (PluginTreeGroup& node, int hash)
+    PluginTreeItem* runMenu (const PluginIndex& index)
     {
-        for (int i = 0; i < node.getNumSubItems(); ++i)
-            if (auto subNode = dynamic_cast<PluginTreeGroup*> (node.getSubItem (i)))
-                if (auto* t = findType (*subNode, hash))
-                    return t;
+        return index.findItem (show());
+    }
 
-        for (int i = 0; i < node.getNumSubItems(); ++i)
-            if (auto t = dynamic_cast<PluginTreeItem*> (node.getSubItem (i)))
-                if (t->getUniqueName().hashCode() == hash)
-                    return t;
+    // Swaps in a rebuilt submenu, leaving the rest of the menu alone
+    void replaceSubMenu (const String& name, juce::PopupMenu newSubMenu)
+    {
+        for (juce::PopupMenu::MenuItemIterator i (*this); i.next();)
+        {
+            auto& item = i.getItem();
+
+            if (item.subMenu != nullptr && item.text == name)
+            {
+                *item.subMenu = std::move (newSubMenu);
+                return;
+            }
+        }
+    }
+};
+
+// Sorting the KnownPluginList and building the tree and menu for thousands of plugins is slow,
+// so it's done once per Edit and then only redone, in the background of the message loop, for
+// the part that changed: the external plugins when the KnownPluginList changes, the racks folder
+// when a rack is added, removed or renamed. Rack changes only touch the entries of the racks that
+// changed and the racks submenu; edits inside a rack are ignored. Showing the menu just shows
+// what's already there.
+class PluginMenuCache : private juce::ChangeListener,
+                        private EngineHelpers::FlaggedAsyncUpdater,
+                        private juce::ValueTree::Listener
+{
+public:
+    PluginMenuCache (tracktion_engine::Edit& e)
+        : edit (e),
+          racksState (e.state.getOrCreateChildWithName (tracktion_engine::IDs::RACKS, nullptr))
+    {
+        auto tree = createPluginTree (edit.engine);
+        root = std::make_unique<PluginTreeGroup> (edit, *tree, tracktion_engine::Plugin::Type::allPlugins);
+        index.rebuild (*root);
+        menu = PluginMenu (*root, index);
 
-        return nullptr;
+        edit.engine.getPluginManager().knownPluginList.addChangeListener (this);
+        racksState.addListener (this);
     }
 
-    PluginTreeItem* runMenu (PluginTreeGroup& node)
+    ~PluginMenuCache() override
     {
-        int res = show();
+        racksState.removeListener (this);
+        edit.engine.getPluginManager().knownPluginList.removeChangeListener (this);
+    }
+
+    // The returned item is only valid until the message loop next runs, so use it straight away
+    PluginTreeItem* showMenu()
+    {
+        handleUpdateNowIfNeeded();
+        return menu.runMenu (index);
+    }
+
+    // IDs from the index stay valid across updates; this returns nullptr if the plugin has gone
+    PluginTreeItem* findItem (int id)
+    {
+        handleUpdateNowIfNeeded();
+        return index.findItem (id);
+    }
+
+    PluginTreeGroup& getTree()
+    {
+        handleUpdateNowIfNeeded();
+        return *root;
+    }
+
+    const PluginIndex& getIndex()
+    {
+        handleUpdateNowIfNeeded();
+        return index;
+    }
+
+private:
+    tracktion_engine::Edit& edit;
+    juce::ValueTree racksState;
+    std::unique_ptr<PluginTreeGroup> root;
+    PluginIndex index;
+    PluginMenu menu;
+
+    bool pluginsChanged = false, racksChanged = false; //async update flags
+
+    void changeListenerCallback (juce::ChangeBroadcaster*) override     { markAndUpdate (pluginsChanged); }
 
-        if (res == 0)
-            return nullptr;
+    // The listener hears about everything under RACKS, including every rack's plugins and windows
+    bool isRack (const juce::ValueTree& v) const                        { return v.hasType (tracktion_engine::IDs::RACK) && v.getParent() == racksState; }
 
-        return findType (node, res);
+    void valueTreePropertyChanged (juce::ValueTree& v, const juce::Identifier& i) override
+    {
+        if (i == tracktion_engine::IDs::name && isRack (v))
+            markAndUpdate (racksChanged);
     }
+
+    void valueTreeChildAdded (juce::ValueTree& parent, juce::ValueTree&) override          { if (parent == racksState) markAndUpdate (racksChanged); }
+    void valueTreeChildRemoved (juce::ValueTree& parent, juce::ValueTree&, int) override   { if (parent == racksState) markAndUpdate (racksChanged); }
+    void valueTreeChildOrderChanged (juce::ValueTree& parent, int, int) override           { if (parent == racksState) markAndUpdate (racksChanged); }
+
+    void handleAsyncUpdate() override
+    {
+        if (compareAndReset (pluginsChanged))
+        {
+            if (auto tree = createPluginTree (edit.engine))
+                root->updateExternalPlugins (*tree);
+
+            index.rebuild (*root);
+            menu = PluginMenu (*root, index);
+            racksChanged = false;
+        }
+
+        if (compareAndReset (racksChanged))
+            updateRacks();
+    }
+
+    // Rack items are named by their position in the rack list, after the "create new" item
+    void updateRacks()
+    {
+        auto folder = root->getRacksFolder();
+
+        if (folder == nullptr)
+            return;
+
+        auto types = edit.getRackList().getTypes();
+
+        for (int i = 0; i < types.size(); ++i)
+        {
+            const auto rackName = types[i]->rackName.get();
+
+            if (auto item = dynamic_cast<PluginTreeItem*> (folder->getSubItem (i + 1)))
+            {
+                if (item->desc.name != rackName)
+                {
+                    item->desc.name = rackName;
+                    index.addItem (*item);
+                }
+            }
+            else
+            {
+                auto newItem = new PluginTreeItem ("RACK__" + String (i), rackName,
+                                                   tracktion_engine::RackInstance::xmlTypeName, false, false);
+                folder->addSubItem (newItem);
+                index.addItem (*newItem);
+            }
+        }
+
+        for (int i = types.size() + 1; i < folder->getNumSubItems(); ++i)
+            if (auto item = dynamic_cast<PluginTreeItem*> (folder->getSubItem (i)))
+                index.removeItem (*item);
+
+        folder->removeSubItems (types.size() + 1);
+        menu.replaceSubMenu (folder->name, PluginMenu (*folder, index));
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PluginMenuCache)
 };
 
-tracktion_engine::Plugin::Ptr showMenuAndCreatePlugin (tracktion_engine::Edit& edit)
+// Non-interactive counterpart of PluginMenuCache::showMenu, for hosts without a menu to show.
+// Matches against the plugin's display name, ignoring case.
+PluginTreeItem* findPluginByName (PluginTreeGroup& node, const String& name)
+{
+    for (int i = 0; i < node.getNumSubItems(); ++i)
+        if (auto subNode = dynamic_cast<PluginTreeGroup*> (node.getSubItem (i)))
+            if (auto* t = findPluginByName (*subNode, name))
+                return t;
+
+    for (int i = 0; i < node.getNumSubItems(); ++i)
+        if (auto t = dynamic_cast<PluginTreeItem*> (node.getSubItem (i)))
+            if (t->desc.name.equalsIgnoreCase (name))
+                return t;
+
+    return nullptr;
+}
+
+tracktion_engine::Plugin::Ptr createPluginByName (tracktion_engine::Edit& edit, const String& name)
 {
     if (auto tree = createPluginTree (edit.engine))
     {
         PluginTreeGroup root (edit, *tree, tracktion_engine::Plugin::Type::allPlugins);
-        PluginMenu m (root);
 
-        if (auto type = m.runMenu (root))
+        if (auto type = findPluginByName (root, name))
             return type->create (edit);
     }
-    
+
     return {};
 }
 
 // PluginComponent is a slightly modified version of what lives in examples/common/Components.h/cpp
 // It's just a text button that allows removal of the plugin via right click, or showing the plugin
-// window via left click
-class PluginComponent : public juce::TextButton
+// window via left click. It also shows how much of the audio callback the plugin uses, on average
+// and the highest that average has been over the last couple of seconds, and the latency it
+// reports. The engine only publishes a smoothed load, so short spikes don't show up in either.
+class PluginComponent : public juce::TextButton,
+                        private juce::Timer
 {
 public:
-    PluginComponent::PluginComponent (tracktion_engine::Plugin::Ptr p)
+    PluginComponent (tracktion_engine::Plugin::Ptr p)
     : plugin (p)
     {
-        setButtonText (plugin->getName().substring (0, 5));
+        setButtonText (plugin->getName());
+        setTooltip (TRANS("CPU: average / highest average in the last 2 s, then latency"));
+        startTimerHz (meterUpdateHz);
     }
     ~PluginComponent() override {}
+
+    tracktion_engine::Plugin::Ptr getPlugin() const     { return plugin; }
+
+    void paintButton (Graphics& g, bool shouldDrawButtonAsHighlighted, bool shouldDrawButtonAsDown) override
+    {
+        auto& lf = getLookAndFeel();
+        lf.drawButtonBackground (g, *this, findColour (getToggleState() ? buttonOnColourId : buttonColourId),
+                                 shouldDrawButtonAsHighlighted, shouldDrawButtonAsDown);
+
+        // A bar behind the text shows the average load, so the worst offenders stand out in a long chain
+        auto b = getLocalBounds().reduced (2);
+        g.setColour (Colours::red.withAlpha (0.5f));
+        g.fillRect (b.withWidth (roundToInt (b.getWidth() * jlimit (0.0, 1.0, averageCpu * 4.0))));
+
+        // Disabled plugins, e.g. those bypassed by live mode, are greyed out
+        g.setColour (findColour (textColourOffId).withMultipliedAlpha (plugin->isEnabled() ? 1.0f : 0.4f));
+        g.setFont (jmin (14.0f, getHeight() * 0.6f));
+        auto metrics = String (averageCpu * 100.0, 1) + "% / " + String (heldCpu * 100.0, 1) + "%";
+
+        if (latencyMs > 0.0)
+            metrics << " / " << String (latencyMs, 1) << " ms";
+
+        auto textArea = b.reduced (2, 0);
+        g.drawText (metrics, textArea, Justification::centredRight, false);
+        g.drawText (getButtonText(), textArea.withTrimmedRight (g.getCurrentFont().getStringWidth (metrics) + 6),
+                    Justification::centredLeft, true);
+    }
     
     using TextButton::clicked;
     void clicked (const ModifierKeys& modifiers) override
@@ -265,7 +673,17 @@ public:
         if (modifiers.isPopupMenu())
         {
             PopupMenu m;
-            m.addItem ("Delete", [this] { plugin->deleteFromParent(); });
+            m.addItem ("Delete", [this]
+                                 {
+                                     if (onDeleteRequested != nullptr)
+                                         onDeleteRequested (plugin);
+                                     else
+                                         plugin->deleteFromParent();
+                                 });
+
+            if (auto conv = dynamic_cast<ConvolutionPlugin*> (plugin.get()))
+                m.addItem ("Load Impulse Response...", [this, conv] { chooseImpulseResponse (*conv); });
+
             m.showAt (this);
         }
         else
@@ -273,9 +691,57 @@ public:
             plugin->showWindowExplicitly();
         }
     }
+
+    // Lets the owner decide what deleting means, e.g. handing the plugin to a PluginInstancePool
+    std::function<void (tracktion_engine::Plugin::Ptr)> onDeleteRequested;
     
 private:
+    static constexpr int meterUpdateHz = 15;
+    static constexpr double holdSeconds = 2.0;
+
     tracktion_engine::Plugin::Ptr plugin;
+    std::unique_ptr<FileChooser> fileChooser;
+    double averageCpu = 0.0, heldCpu = 0.0, latencyMs = 0.0;
+    int ticksSinceHeld = 0;
+    bool wasEnabled = true;
+
+    // Built-in plugins have no editor, so the impulse response is picked from the menu
+    void chooseImpulseResponse (ConvolutionPlugin& conv)
+    {
+        fileChooser = std::make_unique<FileChooser> ("Choose an impulse response", conv.getImpulseResponse(),
+                                                     plugin->engine.getAudioFileFormatManager().readFormatManager.getWildcardForAllFormats());
+
+        fileChooser->launchAsync (FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                                  [&conv] (const FileChooser& fc)
+                                  {
+                                      if (fc.getResult().existsAsFile())
+                                          conv.setImpulseResponse (fc.getResult());
+                                  });
+    }
+
+    // The engine times each plugin's process call on the audio thread and publishes the
+    // smoothed result through an atomic, so reading it here never contends with the audio thread
+    void timerCallback() override
+    {
+        const auto cpu = plugin->getCpuUsage();
+        const auto latency = plugin->getLatencySeconds() * 1000.0;
+
+        const auto previousHeld = heldCpu;
+
+        if (cpu >= heldCpu || ++ticksSinceHeld > holdSeconds * meterUpdateHz)
+        {
+            heldCpu = cpu;
+            ticksSinceHeld = 0;
+        }
+
+        if (cpu != averageCpu || heldCpu != previousHeld || latency != latencyMs || plugin->isEnabled() != wasEnabled)
+        {
+            averageCpu = cpu;
+            latencyMs = latency;
+            wasEnabled = plugin->isEnabled();
+            repaint();
+        }
+    }
 };
 
 
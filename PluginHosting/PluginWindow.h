@@ -1,5 +1,7 @@
 #pragma once
 
+#include "PluginStateTracker.h"
+
 bool isDPIAware (tracktion_engine::Plugin&)
 {
 	// You should keep a DB of if plugins are DPI aware or not and recall that value
@@ -15,6 +17,9 @@ public:
     virtual ComponentBoundsConstrainer* getBoundsConstrainer() = 0;
 };
 
+// Returns the tracker owned by the engine's ExtendedUIBehaviour, if it has one
+PluginStateTracker* getStateTrackerFor (tracktion_engine::Plugin&);
+
 //==============================================================================
 struct AudioProcessorEditorContentComp : public PluginEditor
 {
@@ -56,7 +61,9 @@ struct AudioProcessorEditorContentComp : public PluginEditor
     {
         if (c == editor.get())
         {
-            plugin.edit.pluginChanged (plugin);
+            if (auto tracker = getStateTrackerFor (plugin))
+                tracker->markDirty (plugin);
+
             resizeToFitEditor();
         }
     }
@@ -74,8 +81,231 @@ struct AudioProcessorEditorContentComp : public PluginEditor
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioProcessorEditorContentComp)
 };
 
+//==============================================================================
+// Keeps the editors of closed plugin windows, hidden, so reopening a window doesn't have to
+// build its editor again.
+//
+// An editor is only handed back to the plugin it was made for, and it has to go before that
+// plugin's processor does. tracktion frees a plugin's processor when the plugin stops processing,
+// so each entry watches its plugin's state and is dropped as that property changes, before the
+// plugin itself hears about it. Entries are also dropped when the plugin leaves its track, and
+// when tracktion asks for the plugin's window content to be recreated. Cached editors hold a
+// reference to their plugin; once nothing else does, the editor is dropped. The cache is bounded
+// by an estimate of memory use: an editor's real heap use can't be seen from outside, so it's
+// taken as two 32-bit images of its size plus a fixed allowance. When over budget, editors that
+// opened quickly are evicted first (oldest first), so the ones that are slow to build stay warm
+// the longest.
+class EditorCache : private Timer
+{
+public:
+    static constexpr double slowOpenMs = 250.0;
+
+    struct Stats
+    {
+        int numCached = 0;
+        size_t estimatedBytes = 0, budgetBytes = 0;
+        String lastOpened;
+        double lastOpenMs = 0.0;
+        bool lastOpenWasWarm = false;
+    };
+
+    EditorCache()                                   { startTimer (2000); }
+    ~EditorCache() override                         { clear(); }
+
+    void setMemoryBudget (size_t bytes)
+    {
+        budgetBytes = bytes;
+        trim();
+        sendStats();
+    }
+
+    void store (tracktion_engine::Plugin& plugin, std::unique_ptr<PluginEditor> editor)
+    {
+        if (editor == nullptr)
+            return;
+
+        forget (plugin);
+
+        if (! isProcessing (plugin.state) || ! plugin.state.getParent().isValid())
+            return;
+
+        const auto bytes = (size_t) editor->getWidth() * (size_t) editor->getHeight() * 8 + perEditorAllowance;
+        entries.push_back ({ &plugin, std::make_unique<ProcessorWatcher> (*this, plugin), std::move (editor), bytes, ++useCounter });
+        trim();
+        sendStats();
+    }
+
+    // Returns the plugin's cached editor, or nullptr if there isn't a usable one
+    std::unique_ptr<PluginEditor> take (tracktion_engine::Plugin& plugin)
+    {
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->plugin.get() == &plugin)
+            {
+                auto editor = std::move (it->editor);
+                entries.erase (it);
+                sendStats();
+
+                return editor;
+            }
+        }
+
+        return {};
+    }
+
+    void forget (tracktion_engine::Plugin& plugin)
+    {
+        const auto numBefore = entries.size();
+
+        JUCE_AUTORELEASEPOOL
+        {
+            entries.erase (std::remove_if (entries.begin(), entries.end(), [&] (auto& e) { return e.plugin.get() == &plugin; }),
+                           entries.end());
+        }
+
+        if (entries.size() != numBefore)
+            sendStats();
+    }
+
+    void recordOpenTime (tracktion_engine::Plugin& plugin, double ms, bool wasWarm)
+    {
+        if (! wasWarm)
+            coldOpenTimes[plugin.itemID.toString()] = ms;
+
+        stats.lastOpened = plugin.getName();
+        stats.lastOpenMs = ms;
+        stats.lastOpenWasWarm = wasWarm;
+        sendStats();
+    }
+
+    double getColdOpenTime (tracktion_engine::Plugin& plugin) const
+    {
+        auto t = coldOpenTimes.find (plugin.itemID.toString());
+        return t != coldOpenTimes.end() ? t->second : 0.0;
+    }
+
+    void clear()
+    {
+        JUCE_AUTORELEASEPOOL
+        {
+            entries.clear();
+        }
+
+        sendStats();
+    }
+
+    Stats getStats() const
+    {
+        auto s = stats;
+        s.numCached = (int) entries.size();
+        s.budgetBytes = budgetBytes;
+        s.estimatedBytes = 0;
+
+        for (auto& e : entries)
+            s.estimatedBytes += e.estimatedBytes;
+
+        return s;
+    }
+
+    std::function<void (const Stats&)> onStatsChanged;
+
+private:
+    static constexpr size_t perEditorAllowance = 8 * 1024 * 1024;
+
+    static bool isProcessing (const ValueTree& state)     { return state.getProperty (tracktion_engine::IDs::process, true); }
+
+    // Listens on the plugin's own state handle, the one the plugin listens on itself. Listeners on
+    // one handle are called newest first, so this is told processing has been turned off before the
+    // plugin is, and the editor goes while the instance it points at still exists. A handle of its
+    // own wouldn't do: separate handles are called in the order they started listening.
+    struct ProcessorWatcher : private ValueTree::Listener
+    {
+        ProcessorWatcher (EditorCache& c, tracktion_engine::Plugin& p) : cache (c), plugin (p)
+        {
+            plugin.state.addListener (this);
+        }
+
+        // The entry's plugin reference outlives this, so the handle is still there
+        ~ProcessorWatcher() override
+        {
+            plugin.state.removeListener (this);
+        }
+
+        // Forgetting the plugin deletes this watcher, so nothing can follow it
+        void valueTreePropertyChanged (ValueTree& v, const Identifier& i) override
+        {
+            if (v == plugin.state && i == tracktion_engine::IDs::process && ! isProcessing (plugin.state))
+                cache.forget (plugin);
+        }
+
+        void valueTreeParentChanged (ValueTree& v) override
+        {
+            if (v == plugin.state && ! plugin.state.getParent().isValid())
+                cache.forget (plugin);
+        }
+
+        EditorCache& cache;
+        tracktion_engine::Plugin& plugin;
+    };
+
+    // Members are destroyed in reverse, so the editor goes before the plugin reference
+    struct Entry
+    {
+        tracktion_engine::Plugin::Ptr plugin;
+        std::unique_ptr<ProcessorWatcher> watcher;
+        std::unique_ptr<PluginEditor> editor;
+        size_t estimatedBytes = 0;
+        uint32 lastUsed = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::map<String, double> coldOpenTimes;
+    size_t budgetBytes = 256 * 1024 * 1024;
+    uint32 useCounter = 0;
+    Stats stats;
+
+    void trim()
+    {
+        while (! entries.empty() && getStats().estimatedBytes > budgetBytes)
+        {
+            auto victim = std::min_element (entries.begin(), entries.end(), [this] (auto& a, auto& b)
+                                            {
+                                                const bool aSlow = getColdOpenTime (*a.plugin) >= slowOpenMs;
+                                                const bool bSlow = getColdOpenTime (*b.plugin) >= slowOpenMs;
+
+                                                return aSlow != bSlow ? bSlow : a.lastUsed < b.lastUsed;
+                                            });
+            entries.erase (victim);
+        }
+    }
+
+    // Drops editors whose plugin has been deleted everywhere but here
+    void timerCallback() override
+    {
+        const auto numBefore = entries.size();
+        entries.erase (std::remove_if (entries.begin(), entries.end(), [] (auto& e) { return e.plugin->getReferenceCount() <= 1; }),
+                       entries.end());
+
+        if (entries.size() != numBefore)
+            sendStats();
+    }
+
+    void sendStats()
+    {
+        if (onStatsChanged != nullptr)
+            onStatsChanged (getStats());
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (EditorCache)
+};
+
+// Returns the cache owned by the engine's ExtendedUIBehaviour, if it has one
+EditorCache* getEditorCacheFor (tracktion_engine::Plugin&);
+
 //=============================================================================
-class PluginWindow : public DocumentWindow
+class PluginWindow : public DocumentWindow,
+                     private AsyncUpdater,
+                     private tracktion_engine::SelectableListener
 {
 public:
     PluginWindow (tracktion_engine::Plugin&);
@@ -93,6 +323,10 @@ public:
 
 private:
     void moved() override;
+    void handleAsyncUpdate() override;
+    void selectableObjectChanged (tracktion_engine::Selectable*) override;
+    void selectableObjectAboutToBeDeleted (tracktion_engine::Selectable*) override {}
+    bool isReadyForEditor() const;
     void userTriedToCloseWindow() override          { plugin.windowState->closeWindowExplicitly(); }
     void closeButtonPressed() override              { userTriedToCloseWindow(); }
     float getDesktopScaleFactor() const override    { return 1.0f; }
@@ -100,6 +334,7 @@ private:
     std::unique_ptr<PluginEditor> createContentComp();
 
     std::unique_ptr<PluginEditor> editor;
+    bool editorWasCached = false, editorNeeded = false;
     
     tracktion_engine::Plugin& plugin;
     tracktion_engine::PluginWindowState& windowState;
@@ -125,6 +360,7 @@ PluginWindow::PluginWindow (tracktion_engine::Plugin& plug)
     setBoundsConstrained (getLocalBounds() + position);
     
     recreateEditor();
+    plugin.addSelectableListener (this);
 
     #if JUCE_LINUX
      setAlwaysOnTop (true);
@@ -134,7 +370,19 @@ PluginWindow::PluginWindow (tracktion_engine::Plugin& plug)
 
 PluginWindow::~PluginWindow()
 {
-    plugin.edit.flushPluginStateIfNeeded (plugin);
+    plugin.removeSelectableListener (this);
+
+    if (auto tracker = getStateTrackerFor (plugin))
+        tracker->markDirty (plugin);
+
+    // Keep the editor for next time the window is opened
+    if (auto cache = getEditorCacheFor (plugin); cache != nullptr && editor != nullptr)
+    {
+        clearContentComponent();
+        setConstrainer (nullptr);
+        cache->store (plugin, std::move (editor));
+    }
+
     setEditor (nullptr);
 }
 
@@ -171,6 +419,7 @@ std::unique_ptr<Component> PluginWindow::create (tracktion_engine::Plugin& plugi
         if (externalPlugin->getAudioPluginInstance() == nullptr)
             return nullptr;
 
+    const auto startMs = Time::getMillisecondCounterHiRes();
     std::unique_ptr<PluginWindow> w;
 
     {
@@ -197,11 +446,25 @@ std::unique_ptr<Component> PluginWindow::create (tracktion_engine::Plugin& plugi
 
     w->show();
 
+    if (auto cache = getEditorCacheFor (plugin))
+        cache->recordOpenTime (plugin, Time::getMillisecondCounterHiRes() - startMs, w->editorWasCached);
+
     return w;
 }
 
 std::unique_ptr<PluginEditor> PluginWindow::createContentComp()
 {
+    editorWasCached = false;
+
+    if (auto cache = getEditorCacheFor (plugin))
+    {
+        if (auto cached = cache->take (plugin))
+        {
+            editorWasCached = true;
+            return cached;
+        }
+    }
+
     if (auto ex = dynamic_cast<tracktion_engine::ExternalPlugin*> (&plugin))
         return std::make_unique<AudioProcessorEditorContentComp> (*ex);
 
@@ -214,21 +477,44 @@ void PluginWindow::recreateEditor()
     setEditor (createContentComp());
 }
 
+// Called when the plugin's processor is being replaced. The new editor is built as soon as the
+// new processor exists: on the next message loop iteration if it's there already, otherwise when
+// the plugin reports that it has changed.
 void PluginWindow::recreateEditorAsync()
 {
     setEditor (nullptr);
+    editorNeeded = true;
+    triggerAsyncUpdate();
+}
+
+bool PluginWindow::isReadyForEditor() const
+{
+    if (auto ex = dynamic_cast<tracktion_engine::ExternalPlugin*> (&plugin))
+        return ex->getAudioPluginInstance() != nullptr;
+
+    return true;
+}
+
+void PluginWindow::handleAsyncUpdate()
+{
+    if (editorNeeded && isReadyForEditor())
+    {
+        editorNeeded = false;
+        recreateEditor();
+    }
+}
 
-    Timer::callAfterDelay (50, [this, sp = SafePointer<Component> (this)]
-                                 {
-                                     if (sp != nullptr)
-                                         recreateEditor();
-                                 });
+void PluginWindow::selectableObjectChanged (tracktion_engine::Selectable*)
+{
+    if (editorNeeded)
+        triggerAsyncUpdate();
 }
 
+// The bounds are written to the plugin's state whenever it's next flushed, so there's
+// nothing else to do here
 void PluginWindow::moved()
 {
     plugin.windowState->lastWindowBounds = getBounds();
-    plugin.edit.pluginChanged (plugin);
 }
 
 //==============================================================================
@@ -247,9 +533,35 @@ public:
 
     void recreatePluginWindowContentAsync (tracktion_engine::Plugin& p) override
     {
+        // Whether or not its window is open, an editor cached for the old processor mustn't be reused
+        editorCache.forget (p);
+
         if (auto* w = dynamic_cast<PluginWindow*> (p.windowState->pluginWindow.get()))
             return w->recreateEditorAsync();
 
         UIBehaviour::recreatePluginWindowContentAsync (p);
     }
+
+    EditorCache& getEditorCache()           { return editorCache; }
+    PluginStateTracker& getStateTracker()   { return stateTracker; }
+
+private:
+    EditorCache editorCache;
+    PluginStateTracker stateTracker;
 };
+
+EditorCache* getEditorCacheFor (tracktion_engine::Plugin& plugin)
+{
+    if (auto behaviour = dynamic_cast<ExtendedUIBehaviour*> (&plugin.engine.getUIBehaviour()))
+        return &behaviour->getEditorCache();
+
+    return nullptr;
+}
+
+PluginStateTracker* getStateTrackerFor (tracktion_engine::Plugin& plugin)
+{
+    if (auto behaviour = dynamic_cast<ExtendedUIBehaviour*> (&plugin.engine.getUIBehaviour()))
+        return &behaviour->getStateTracker();
+
+    return nullptr;
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+//==============================================================================
+// A library of plugin chain presets whose plugin states live in a content-addressed store.
+//
+// Large state blobs, picked out the same way BinarySession does, are taken out of a preset's
+// tree and saved once each, named by the SHA-256 of their contents. Presets that share a
+// sampler's multi-megabyte state share one copy of it on disk. The preset file itself is just
+// the tree with each blob replaced by its hash, so it's small and quick to parse. Loading reads
+// only the blobs that aren't already in the in-memory cache, which keeps recently used blobs up
+// to a byte budget.
+//
+// Layout:  <root>/<name>.chain      the tree, written with ValueTree::writeToStream
+//          <root>/blobs/<sha256>    the raw bytes of one blob
+//
+// A chain preset holds a track's plugins, without its volume and level meter, plus the rack
+// types used by any racks in the chain. Message thread only.
+class PresetLibrary
+{
+public:
+    struct LoadStats
+    {
+        double ms = 0.0;
+        int numBlobs = 0, blobsFromCache = 0;
+        juce::int64 bytesRead = 0;
+    };
+
+    struct StorageStats
+    {
+        int numPresets = 0, numBlobs = 0;
+        juce::int64 logicalBytes = 0;       // if every preset held its own copy of its blobs
+        juce::int64 storedBytes = 0;        // what's actually on disk
+
+        double getSavedFraction() const     { return logicalBytes > 0 ? 1.0 - (double) storedBytes / (double) logicalBytes : 0.0; }
+    };
+
+    static constexpr const char* fileExtension = ".chain";
+    static constexpr const char* hashPropertyPrefix = "sha256_";
+
+    PresetLibrary (const juce::File& rootDirectory, size_t cacheBudgetBytes = 256 * 1024 * 1024)
+        : root (rootDirectory), cacheBudget (cacheBudgetBytes)
+    {
+    }
+
+    const juce::File& getRoot() const       { return root; }
+
+    juce::StringArray getPresetNames() const
+    {
+        juce::StringArray names;
+
+        for (auto& f : root.findChildFiles (juce::File::findFiles, false, juce::String ("*") + fileExtension))
+            names.add (f.getFileNameWithoutExtension());
+
+        names.sortNatural();
+        return names;
+    }
+
+    //==============================================================================
+    bool saveTree (const juce::String& name, const juce::ValueTree& preset)
+    {
+        auto tree = preset.createCopy();
+
+        if (! getBlobDirectory().createDirectory() || ! storeBlobs (tree))
+            return false;
+
+        juce::TemporaryFile temp (getPresetFile (name));
+
+        {
+            juce::FileOutputStream out (temp.getFile());
+
+            if (! out.openedOk())
+                return false;
+
+            tree.writeToStream (out);
+        }
+
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+    // Returns an invalid tree if the preset or any of its blobs is missing
+    juce::ValueTree loadTree (const juce::String& name, LoadStats& stats)
+    {
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        juce::FileInputStream in (getPresetFile (name));
+
+        if (! in.openedOk())
+            return {};
+
+        auto tree = juce::ValueTree::readFromStream (in);
+
+        if (! restoreBlobs (tree, stats))
+            tree = {};
+
+        stats.ms = juce::Time::getMillisecondCounterHiRes() - start;
+        return tree;
+    }
+
+    //==============================================================================
+    bool saveChain (const juce::String& name, tracktion_engine::AudioTrack& track)
+    {
+        track.edit.flushState();
+        juce::ValueTree preset (chainPresetID), plugins (pluginsID), racks (racksID);
+
+        for (auto p : track.pluginList)
+        {
+            if (dynamic_cast<tracktion_engine::VolumeAndPanPlugin*> (p) != nullptr
+                 || dynamic_cast<tracktion_engine::LevelMeterPlugin*> (p) != nullptr)
+                continue;
+
+            plugins.appendChild (p->state.createCopy(), nullptr);
+
+            if (auto rack = dynamic_cast<tracktion_engine::RackInstance*> (p))
+                if (rack->type != nullptr && ! racks.getChildWithProperty (tracktion_engine::IDs::id, rack->type->state[tracktion_engine::IDs::id]).isValid())
+                    racks.appendChild (rack->type->state.createCopy(), nullptr);
+        }
+
+        preset.appendChild (racks, nullptr);
+        preset.appendChild (plugins, nullptr);
+        return saveTree (name, preset);
+    }
+
+    // Adds the preset's plugins to the end of the track's chain. Every item in the preset gets a
+    // new ID first, so loading a preset twice, or into the Edit it came from, never gives two
+    // items the same ID, and its racks become new rack types rather than sharing existing ones.
+    bool loadChain (const juce::String& name, tracktion_engine::AudioTrack& track, LoadStats& stats)
+    {
+        auto preset = loadTree (name, stats);
+
+        if (! preset.hasType (chainPresetID))
+            return false;
+
+        // Noted before remapping, so each rack instance can be pointed at its own copy of its rack type
+        std::vector<std::pair<juce::ValueTree, tracktion_engine::EditItemID>> rackInstances;
+        findRackInstances (preset, rackInstances);
+
+        std::unordered_map<tracktion_engine::EditItemID, tracktion_engine::EditItemID> newIDs;
+        tracktion_engine::EditItemID::remapIDs (preset, nullptr, track.edit, &newIDs);
+
+        for (auto& [instance, oldType] : rackInstances)
+        {
+            auto newType = newIDs.find (oldType);
+
+            if (newType != newIDs.end())
+                instance.setProperty (tracktion_engine::IDs::rackType, newType->second.toVar(), nullptr);
+        }
+
+        auto& rackList = track.edit.getRackList();
+
+        for (auto rack : preset.getChildWithName (racksID))
+            rackList.addRackTypeFrom (rack);
+
+        for (auto plugin : preset.getChildWithName (pluginsID))
+            track.pluginList.insertPlugin (plugin.createCopy(), track.pluginList.size());
+
+        return true;
+    }
+
+    //==============================================================================
+    StorageStats getStorageStats() const
+    {
+        StorageStats stats;
+        std::map<juce::String, juce::int64> blobSizes;
+
+        for (auto& f : getBlobDirectory().findChildFiles (juce::File::findFiles, false))
+        {
+            blobSizes[f.getFileName()] = f.getSize();
+            stats.storedBytes += f.getSize();
+            ++stats.numBlobs;
+        }
+
+        for (auto& name : getPresetNames())
+        {
+            auto file = getPresetFile (name);
+            juce::FileInputStream in (file);
+            juce::StringArray hashes;
+
+            if (in.openedOk())
+                findHashes (juce::ValueTree::readFromStream (in), hashes);
+
+            for (auto& h : hashes)
+                stats.logicalBytes += blobSizes[h];
+
+            stats.logicalBytes += file.getSize();
+            stats.storedBytes += file.getSize();
+            ++stats.numPresets;
+        }
+
+        return stats;
+    }
+
+    void clearCache()
+    {
+        cache.clear();
+        cachedBytes = 0;
+    }
+
+private:
+    struct CachedBlob
+    {
+        juce::MemoryBlock data;
+        juce::uint64 lastUsed = 0;
+    };
+
+    const juce::Identifier chainPresetID { "CHAINPRESET" }, pluginsID { "PLUGINS" }, racksID { "RACKS" };
+
+    juce::File root;
+    size_t cacheBudget, cachedBytes = 0;
+    std::map<juce::String, CachedBlob> cache;
+    juce::uint64 useCounter = 0;
+
+    juce::File getPresetFile (const juce::String& name) const   { return root.getChildFile (juce::File::createLegalFileName (name) + fileExtension); }
+    juce::File getBlobDirectory() const                         { return root.getChildFile ("blobs"); }
+
+    static void findRackInstances (const juce::ValueTree& v, std::vector<std::pair<juce::ValueTree, tracktion_engine::EditItemID>>& instances)
+    {
+        if (v.hasType (tracktion_engine::IDs::PLUGIN) && v[tracktion_engine::IDs::type] == tracktion_engine::RackInstance::xmlTypeName)
+            instances.push_back ({ v, tracktion_engine::EditItemID::fromProperty (v, tracktion_engine::IDs::rackType) });
+
+        for (auto child : v)
+            findRackInstances (child, instances);
+    }
+
+    // Writes each blob that isn't stored already, and replaces it in the tree with its hash
+    bool storeBlobs (juce::ValueTree& v)
+    {
+        for (int i = v.getNumProperties(); --i >= 0;)
+        {
+            const auto name = v.getPropertyName (i);
+            juce::MemoryBlock raw;
+
+            if (! BinarySession::getBlobData (name, v[name], raw))
+                continue;
+
+            const auto hash = juce::SHA256 (raw.getData(), raw.getSize()).toHexString();
+            auto file = getBlobDirectory().getChildFile (hash);
+
+            if (file.getSize() != (juce::int64) raw.getSize())
+            {
+                juce::TemporaryFile temp (file);
+
+                if (! temp.getFile().replaceWithData (raw.getData(), raw.getSize()) || ! temp.overwriteTargetFileWithTemporary())
+                    return false;
+            }
+
+            v.setProperty (hashPropertyPrefix + name.toString(), hash, nullptr);
+            v.removeProperty (name, nullptr);
+            addToCache (hash, std::move (raw));
+        }
+
+        for (auto child : v)
+            if (! storeBlobs (child))
+                return false;
+
+        return true;
+    }
+
+    bool restoreBlobs (juce::ValueTree& v, LoadStats& stats)
+    {
+        for (int i = v.getNumProperties(); --i >= 0;)
+        {
+            const auto name = v.getPropertyName (i).toString();
+
+            if (! name.startsWith (hashPropertyPrefix))
+                continue;
+
+            auto blob = fetch (v[name].toString(), stats);
+
+            if (blob == nullptr)
+                return false;
+
+            v.setProperty (name.substring ((int) strlen (hashPropertyPrefix)), juce::var (blob->getData(), blob->getSize()), nullptr);
+            v.removeProperty (name, nullptr);
+        }
+
+        for (auto child : v)
+            if (! restoreBlobs (child, stats))
+                return false;
+
+        return true;
+    }
+
+    static void findHashes (const juce::ValueTree& v, juce::StringArray& hashes)
+    {
+        for (int i = 0; i < v.getNumProperties(); ++i)
+            if (v.getPropertyName (i).toString().startsWith (hashPropertyPrefix))
+                hashes.add (v[v.getPropertyName (i)].toString());
+
+        for (auto child : v)
+            findHashes (child, hashes);
+    }
+
+    // The returned block is only valid until the cache next changes
+    const juce::MemoryBlock* fetch (const juce::String& hash, LoadStats& stats)
+    {
+        ++stats.numBlobs;
+        auto it = cache.find (hash);
+
+        if (it != cache.end())
+        {
+            ++stats.blobsFromCache;
+            it->second.lastUsed = ++useCounter;
+            return &it->second.data;
+        }
+
+        juce::MemoryBlock data;
+
+        if (! getBlobDirectory().getChildFile (hash).loadFileAsData (data))
+            return nullptr;
+
+        stats.bytesRead += (juce::int64) data.getSize();
+        return addToCache (hash, std::move (data));
+    }
+
+    // Evicts the least recently used blobs, but never the one just added
+    const juce::MemoryBlock* addToCache (const juce::String& hash, juce::MemoryBlock data)
+    {
+        auto& entry = cache[hash];
+        cachedBytes -= entry.data.getSize();
+        cachedBytes += data.getSize();
+        entry.data = std::move (data);
+        entry.lastUsed = ++useCounter;
+
+        while (cachedBytes > cacheBudget && cache.size() > 1)
+        {
+            auto oldest = cache.end();
+
+            for (auto i = cache.begin(); i != cache.end(); ++i)
+                if (i->first != hash && (oldest == cache.end() || i->second.lastUsed < oldest->second.lastUsed))
+                    oldest = i;
+
+            cachedBytes -= oldest->second.data.getSize();
+            cache.erase (oldest);
+        }
+
+        return &cache[hash].data;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PresetLibrary)
+};
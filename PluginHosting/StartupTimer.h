@@ -0,0 +1,54 @@
+#pragma once
+
+//==============================================================================
+// Times each phase of startup, from when the object is created (as a member of the
+// JUCEApplication, which is about as early as app code runs) to the phase being marked.
+class StartupTimer
+{
+public:
+    struct Phase
+    {
+        juce::String name;
+        double durationMs = 0.0, endMs = 0.0;
+    };
+
+    StartupTimer() : startMs (juce::Time::getMillisecondCounterHiRes()), lastMs (startMs) {}
+
+    void mark (const juce::String& phase)
+    {
+        const auto now = juce::Time::getMillisecondCounterHiRes();
+        phases.push_back ({ phase, now - lastMs, now - startMs });
+        lastMs = now;
+    }
+
+    // How long after startup the phase ended, or -1 if it hasn't been marked
+    double getTimeOf (const juce::String& phase) const
+    {
+        for (auto& p : phases)
+            if (p.name == phase)
+                return p.endMs;
+
+        return -1.0;
+    }
+
+    const std::vector<Phase>& getPhases() const     { return phases; }
+
+    juce::String toText() const
+    {
+        juce::String text ("Startup phases:\n");
+
+        for (auto& p : phases)
+            text << "  " << p.name.paddedRight (' ', 28)
+                 << ("+" + juce::String (p.durationMs, 1) + " ms").paddedRight (' ', 14)
+                 << "at " << juce::String (p.endMs, 1) << " ms\n";
+
+        return text;
+    }
+
+private:
+    const double startMs;
+    double lastMs;
+    std::vector<Phase> phases;
+
+    JUCE_DECLARE_NON_COPYABLE (StartupTimer)
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+//==============================================================================
+// Loads audio files onto tracks without making the first play wait for the disk.
+//
+// The clip goes onto the track and starts looping straight away. The engine's AudioFileCache
+// serves the audio thread from blocks it has already read, so it never waits on I/O itself.
+// What stalls playback is the cache waiting for pages that aren't resident, or for a compressed
+// file to be decoded. A background thread deals with both:
+//  - uncompressed files (WAV, AIFF) are memory mapped and the loop region is touched page by
+//    page, so it's resident before the playhead gets there. The mapping is kept open, up to
+//    maxPinnedBytes in total, so the region stays mapped while it loops.
+//  - compressed files are decoded, in fixed-size blocks, into a WAV proxy in the temp folder.
+//    Once that's done, the clip's source is switched to the proxy, which is then mapped as
+//    above. Proxies are named after the source's path, size and modification time, so loading
+//    the same file again uses the existing proxy.
+class StreamingAudioLoader : private juce::Thread
+{
+public:
+    StreamingAudioLoader (tracktion_engine::Engine& e)
+        : juce::Thread ("Audio Read-ahead"), engine (e)
+    {
+        startThread();
+    }
+
+    ~StreamingAudioLoader() override
+    {
+        stopThread (10000);
+    }
+
+    // Puts the file on the track and starts looping it. Returns nullptr if it couldn't be read.
+    tracktion_engine::WaveAudioClip::Ptr loadAndLoop (tracktion_engine::AudioTrack& track, const juce::File& file)
+    {
+        const auto proxy = getProxyFile (file);
+        const bool needsProxy = ! canMemoryMap (file);
+        const auto source = needsProxy && proxy.existsAsFile() ? proxy : file;
+
+        auto clip = EngineHelpers::loadAudioFileAsClip (track, source);
+
+        if (clip == nullptr)
+            return {};
+
+        clip->setName (file.getFileNameWithoutExtension());
+        EngineHelpers::loopAroundClip (*clip);
+
+        Job job { ++lastJobId, source, needsProxy && source == file ? proxy : juce::File() };
+
+        if (job.proxy != juce::File())
+            clipsAwaitingProxy[job.id] = clip;
+
+        {
+            const juce::ScopedLock sl (jobLock);
+            jobs.push_back (job);
+        }
+
+        notify();
+        return clip;
+    }
+
+    // Called on the message thread as files are decoded and mapped
+    std::function<void (const juce::String&)> onStatusChanged;
+
+private:
+    static constexpr int decodeBlockSize = 65536;
+    static constexpr juce::int64 maxPinnedBytes = (juce::int64) 1024 * 1024 * 1024;
+    static constexpr int pageSize = 4096;
+
+    struct Job
+    {
+        int id = 0;
+        juce::File source, proxy;
+    };
+
+    tracktion_engine::Engine& engine;
+    juce::CriticalSection jobLock;
+    std::deque<Job> jobs;
+    int lastJobId = 0;
+
+    // Only touched on the message thread
+    std::map<int, tracktion_engine::WaveAudioClip::Ptr> clipsAwaitingProxy;
+
+    // Only touched on the background thread; the most recently loaded is last
+    std::vector<std::unique_ptr<juce::MemoryMappedAudioFormatReader>> pinnedReaders;
+
+    juce::File getProxyFile (const juce::File& source) const
+    {
+        const auto name = juce::String::toHexString (source.getFullPathName().hashCode64())
+                            + "_" + juce::String (source.getSize())
+                            + "_" + juce::String (source.getLastModificationTime().toMilliseconds());
+
+        return engine.getTemporaryFileManager().getTempDirectory().getChildFile ("Proxies")
+                     .getChildFile (name).withFileExtension ("wav");
+    }
+
+    juce::MemoryMappedAudioFormatReader* createMemoryMappedReader (const juce::File& file) const
+    {
+        if (auto format = engine.getAudioFileFormatManager().readFormatManager.findFormatForFileExtension (file.getFileExtension()))
+            return format->createMemoryMappedReader (file);
+
+        return nullptr;
+    }
+
+    bool canMemoryMap (const juce::File& file) const
+    {
+        return std::unique_ptr<juce::MemoryMappedAudioFormatReader> (createMemoryMappedReader (file)) != nullptr;
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            Job job;
+
+            {
+                const juce::ScopedLock sl (jobLock);
+
+                if (! jobs.empty())
+                {
+                    job = jobs.front();
+                    jobs.pop_front();
+                }
+            }
+
+            if (job.id == 0)
+            {
+                wait (-1);
+                continue;
+            }
+
+            auto playable = job.source;
+
+            if (job.proxy != juce::File() && decodeToProxy (job.source, job.proxy))
+            {
+                playable = job.proxy;
+                postToMessageThread ([id = job.id, proxy = job.proxy] (StreamingAudioLoader& l) { l.switchToProxy (id, proxy); });
+            }
+            else if (job.proxy != juce::File())
+            {
+                postToMessageThread ([id = job.id] (StreamingAudioLoader& l) { l.clipsAwaitingProxy.erase (id); });
+            }
+
+            pinLoopRegion (playable);
+        }
+    }
+
+    // Reads the source a block at a time, so memory use doesn't grow with the file's length
+    bool decodeToProxy (const juce::File& source, const juce::File& proxy)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader (engine.getAudioFileFormatManager().readFormatManager.createReaderFor (source));
+
+        if (reader == nullptr)
+            return false;
+
+        proxy.getParentDirectory().createDirectory();
+        juce::TemporaryFile partial (proxy);
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+
+        if (auto out = partial.getFile().createOutputStream())
+        {
+            const int bits = reader->usesFloatingPointData ? 32 : juce::jlimit (16, 24, (int) reader->bitsPerSample);
+            writer.reset (juce::WavAudioFormat().createWriterFor (out.get(), reader->sampleRate, reader->numChannels, bits, {}, 0));
+
+            if (writer != nullptr)
+                out.release();
+        }
+
+        if (writer == nullptr)
+            return false;
+
+        juce::AudioBuffer<float> block ((int) reader->numChannels, decodeBlockSize);
+        const auto length = reader->lengthInSamples;
+        auto lastReport = juce::Time::getMillisecondCounter();
+
+        for (juce::int64 pos = 0; pos < length; pos += decodeBlockSize)
+        {
+            if (threadShouldExit())
+                return false;
+
+            const auto num = (int) juce::jmin ((juce::int64) decodeBlockSize, length - pos);
+            reader->read (&block, 0, num, pos, true, true);
+
+            if (! writer->writeFromAudioSampleBuffer (block, 0, num))
+                return false;
+
+            if (juce::Time::getMillisecondCounter() - lastReport > 250)
+            {
+                lastReport = juce::Time::getMillisecondCounter();
+                reportStatus ("Decoding " + source.getFileName() + ": " + juce::String (100 * pos / juce::jmax ((juce::int64) 1, length)) + "%");
+            }
+        }
+
+        writer.reset();
+        return partial.overwriteTargetFileWithTemporary();
+    }
+
+    // Maps the start of the file (which is where the loop is, see EngineHelpers::loopAroundClip)
+    // and touches every page of it, then keeps the mapping open
+    void pinLoopRegion (const juce::File& file)
+    {
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader (createMemoryMappedReader (file));
+
+        if (reader == nullptr)
+            return;
+
+        const auto bytesPerFrame = (juce::int64) juce::jmax (1, (int) (reader->numChannels * reader->bitsPerSample / 8));
+        const auto numFrames = juce::jmin (reader->lengthInSamples, maxPinnedBytes / bytesPerFrame);
+
+        if (! reader->mapSectionOfFile ({ 0, numFrames }))
+            return;
+
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        const auto framesPerPage = juce::jmax ((juce::int64) 1, pageSize / bytesPerFrame);
+
+        for (juce::int64 s = 0; s < numFrames && ! threadShouldExit(); s += framesPerPage)
+            reader->touchSample (s);
+
+        const auto ms = juce::Time::getMillisecondCounterHiRes() - start;
+        const auto mappedMB = (double) (numFrames * bytesPerFrame) / (1024.0 * 1024.0);
+
+        pinnedReaders.push_back (std::move (reader));
+        unpinOldest();
+
+        reportStatus ("Loaded " + file.getFileName() + ": " + juce::String (mappedMB, 1) + " MB resident in "
+                        + juce::String ((int) ms) + " ms");
+    }
+
+    void unpinOldest()
+    {
+        juce::int64 total = 0;
+
+        for (auto& r : pinnedReaders)
+            total += r->getNumBytesUsed();
+
+        while (pinnedReaders.size() > 1 && total > maxPinnedBytes)
+        {
+            total -= pinnedReaders.front()->getNumBytesUsed();
+            pinnedReaders.erase (pinnedReaders.begin());
+        }
+    }
+
+    void switchToProxy (int jobId, const juce::File& proxy)
+    {
+        auto it = clipsAwaitingProxy.find (jobId);
+
+        if (it == clipsAwaitingProxy.end())
+            return;
+
+        auto clip = it->second;
+        clipsAwaitingProxy.erase (it);
+
+        // The clip may have been replaced while its proxy was decoding
+        if (clip->state.getParent().isValid())
+            clip->getSourceFileReference().setToDirectFileReference (proxy, false);
+    }
+
+    void reportStatus (const juce::String& status)
+    {
+        postToMessageThread ([status] (StreamingAudioLoader& l)
+                             {
+                                 if (l.onStatusChanged != nullptr)
+                                     l.onStatusChanged (status);
+                             });
+    }
+
+    void postToMessageThread (std::function<void (StreamingAudioLoader&)> f)
+    {
+        juce::MessageManager::callAsync ([ref = juce::WeakReference<StreamingAudioLoader> (this), f]
+                                         {
+                                             if (auto l = ref.get())
+                                                 f (*l);
+                                         });
+    }
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (StreamingAudioLoader)
+    JUCE_DECLARE_NON_COPYABLE (StreamingAudioLoader)
+};
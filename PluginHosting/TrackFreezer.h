@@ -0,0 +1,346 @@
+#pragma once
+
+//==============================================================================
+// Freezes a track: renders its clips through its plugin chain to a file, then plays that file
+// instead and unloads the plugins.
+//
+// The live Edit keeps playing while the render runs. The render uses a copy of the Edit, made
+// for rendering, so it has its own plugin instances and never touches the ones being played.
+// The copy only holds the track being frozen and the racks it uses, so only that track's plugins
+// are loaded a second time. It's built and its render prepared on the message thread; the render
+// itself runs on a background thread, as fast as it can. Once it's done, the track's clips and
+// plugins are stashed (plugin state is flushed first) and replaced by a clip of the rendered
+// file. Everything else holding on to the plugins lets go first, so they're really unloaded.
+// The level meter is kept, as it doesn't change the sound. Unfreezing puts the stashed clips and
+// plugins back where they were and deletes the render.
+//
+// Renders live in temporary space and the stash only in memory, so a saved session holds each
+// frozen track as it was before freezing (see restoreInTree) and opens unfrozen.
+class TrackFreezer
+{
+public:
+    TrackFreezer (tracktion_engine::Edit& e, PluginInstancePool& p, LiveLatencyGuard& g)
+        : edit (e), pool (p), liveGuard (g) {}
+
+    ~TrackFreezer()
+    {
+        cancelled = true;
+        renderThreads.removeAllJobs (true, 30000);
+    }
+
+    bool isFrozen (const tracktion_engine::AudioTrack& t) const     { return frozen.find (t.itemID.toString()) != frozen.end(); }
+    bool isFreezing (const tracktion_engine::AudioTrack& t) const   { return freezing.count (t.itemID.toString()) > 0; }
+
+    // onFinished is called on the message thread, with true if the track was frozen
+    void freeze (tracktion_engine::AudioTrack& track, std::function<void (bool)> onFinished)
+    {
+        const auto id = track.itemID.toString();
+
+        if (isFrozen (track) || isFreezing (track))
+            return;
+
+        edit.flushState();
+
+        auto render = std::make_shared<Render>();
+        render->trackName = track.getName();
+        render->chainCpuBefore = getChainCpu (track);
+        render->deviceCpuBefore = edit.engine.getDeviceManager().getCpuUsage();
+        render->file = edit.engine.getTemporaryFileManager().getTempDirectory().getChildFile ("Freeze")
+                         .getNonexistentChildFile (juce::File::createLegalFileName (render->trackName) + "_freeze", ".wav");
+        render->file.getParentDirectory().createDirectory();
+
+        tracktion_engine::Edit::Options options { edit.engine, createRenderState (track), tracktion_engine::ProjectItemID::createNewID (0) };
+        options.role = tracktion_engine::Edit::forRendering;
+        render->copy = std::make_unique<tracktion_engine::Edit> (options);
+
+        juce::BigInteger tracksToDo;
+        auto copyTracks = tracktion_engine::getAllTracks (*render->copy);
+
+        for (int i = 0; i < copyTracks.size(); ++i)
+            if (copyTracks[i]->itemID == track.itemID)
+                tracksToDo.setBit (i);
+
+        auto& dm = edit.engine.getDeviceManager();
+        auto params = OfflineRender::createParameters (*render->copy, render->file, tracksToDo,
+                                                       dm.getSampleRate(), juce::jmax (512, dm.getBlockSize()));
+        params.useMasterPlugins = false;
+        render->audioSeconds = params.time.getLength();
+        render->task = std::make_unique<tracktion_engine::Renderer::RenderTask> ("Freeze", params, &render->progress, nullptr);
+
+        freezing.insert (id);
+        reportStatus ("Freezing " + render->trackName + "...");
+
+        renderThreads.addJob ([ref = juce::WeakReference<TrackFreezer> (this), flag = &cancelled, render, id, onFinished]() mutable
+                              {
+                                  const auto start = juce::Time::getMillisecondCounterHiRes();
+
+                                  while (! flag->load() && render->task->runJob() == juce::ThreadPoolJob::jobNeedsRunningAgain)
+                                  {}
+
+                                  render->wallSeconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+                                  render->ok = ! flag->load() && render->task->errorMessage.isEmpty() && render->file.existsAsFile();
+
+                                  // The copied Edit is deleted on the message thread
+                                  juce::MessageManager::callAsync ([ref, render = std::move (render), id, onFinished]
+                                                                   {
+                                                                       if (auto f = ref.get())
+                                                                           f->finishFreezing (*render, id, onFinished);
+                                                                   });
+                              });
+    }
+
+    void unfreeze (tracktion_engine::AudioTrack& track)
+    {
+        auto it = frozen.find (track.itemID.toString());
+
+        if (it == frozen.end())
+            return;
+
+        EngineHelpers::removeAllClips (track);
+
+        for (auto& clip : it->second.clips)
+            track.state.appendChild (clip, nullptr);
+
+        for (auto& [index, state] : it->second.plugins)
+            track.pluginList.insertPlugin (state, index);
+
+        it->second.renderedFile.deleteFile();
+        frozen.erase (it);
+        reportStatus ("Unfroze " + track.getName());
+    }
+
+    // For a copy of the Edit's state about to be saved. Puts each frozen track's stashed clips and
+    // plugins back in place of the render, as unfreeze() would, without touching the Edit.
+    void restoreInTree (juce::ValueTree& editState) const
+    {
+        for (auto& [id, frozenTrack] : frozen)
+        {
+            auto trackState = findTrackState (editState, id);
+
+            if (! trackState.isValid())
+                continue;
+
+            for (int i = trackState.getNumChildren(); --i >= 0;)
+                if (tracktion_engine::Clip::isClipState (trackState.getChild (i)))
+                    trackState.removeChild (i, nullptr);
+
+            for (auto& clip : frozenTrack.clips)
+                trackState.appendChild (clip.createCopy(), nullptr);
+
+            for (auto& [index, state] : frozenTrack.plugins)
+                insertPluginState (trackState, state.createCopy(), index);
+        }
+    }
+
+    // Called on the message thread
+    std::function<void (const juce::String&)> onStatusChanged;
+
+private:
+    struct Render
+    {
+        std::unique_ptr<tracktion_engine::Edit> copy;
+        std::unique_ptr<tracktion_engine::Renderer::RenderTask> task;
+        std::atomic<float> progress { 0.0f };
+        juce::File file;
+        juce::String trackName;
+        double chainCpuBefore = 0.0, deviceCpuBefore = 0.0, audioSeconds = 0.0, wallSeconds = 0.0;
+        bool ok = false;
+    };
+
+    struct FrozenTrack
+    {
+        std::vector<juce::ValueTree> clips;
+        std::vector<std::pair<int, juce::ValueTree>> plugins;
+        juce::File renderedFile;
+    };
+
+    tracktion_engine::Edit& edit;
+    PluginInstancePool& pool;
+    LiveLatencyGuard& liveGuard;
+    std::map<juce::String, FrozenTrack> frozen;
+    std::set<juce::String> freezing;
+    std::atomic<bool> cancelled { false };
+    juce::ThreadPool renderThreads { 1 };
+
+    // A copy of the Edit without its other tracks, master plugins, or racks the track doesn't use
+    juce::ValueTree createRenderState (const tracktion_engine::AudioTrack& track) const
+    {
+        namespace IDs = tracktion_engine::IDs;
+        auto state = edit.state.createCopy();
+
+        for (int i = state.getNumChildren(); --i >= 0;)
+        {
+            auto child = state.getChild (i);
+
+            if ((child.hasType (IDs::TRACK) || child.hasType (IDs::FOLDERTRACK)) && child[IDs::id] != track.state[IDs::id])
+                state.removeChild (i, nullptr);
+            else if (child.hasType (IDs::MASTERPLUGINS))
+                child.removeAllChildren (nullptr);
+        }
+
+        // Racks can hold other racks, so keep going until nothing new turns up
+        auto racks = state.getChildWithName (IDs::RACKS);
+        juce::StringArray usedRacks;
+        findRackTypes (track.state, usedRacks);
+
+        for (int numChecked = 0; numChecked < usedRacks.size(); ++numChecked)
+            findRackTypes (racks.getChildWithProperty (IDs::id, usedRacks[numChecked]), usedRacks);
+
+        for (int i = racks.getNumChildren(); --i >= 0;)
+            if (! usedRacks.contains (racks.getChild (i)[IDs::id].toString()))
+                racks.removeChild (i, nullptr);
+
+        return state;
+    }
+
+    static void findRackTypes (const juce::ValueTree& v, juce::StringArray& rackIds)
+    {
+        if (v.hasType (tracktion_engine::IDs::PLUGIN) && v[tracktion_engine::IDs::type] == tracktion_engine::RackInstance::xmlTypeName)
+            rackIds.addIfNotAlreadyThere (v[tracktion_engine::IDs::rackType].toString());
+
+        for (auto child : v)
+            findRackTypes (child, rackIds);
+    }
+
+    static juce::ValueTree findTrackState (const juce::ValueTree& parent, const juce::String& id)
+    {
+        for (auto child : parent)
+        {
+            if (! child.hasType (tracktion_engine::IDs::TRACK) && ! child.hasType (tracktion_engine::IDs::FOLDERTRACK))
+                continue;
+
+            if (child[tracktion_engine::IDs::id].toString() == id)
+                return child;
+
+            if (auto nested = findTrackState (child, id); nested.isValid())
+                return nested;
+        }
+
+        return {};
+    }
+
+    // Where PluginList::insertPlugin would put it: before the plugin now at index, or after the last one
+    static void insertPluginState (juce::ValueTree& trackState, const juce::ValueTree& pluginState, int index)
+    {
+        int numPlugins = 0, insertAt = -1;
+
+        for (int i = 0; i < trackState.getNumChildren(); ++i)
+        {
+            if (! trackState.getChild (i).hasType (tracktion_engine::IDs::PLUGIN))
+                continue;
+
+            if (numPlugins++ == index)
+            {
+                trackState.addChild (pluginState, i, nullptr);
+                return;
+            }
+
+            insertAt = i + 1;
+        }
+
+        trackState.addChild (pluginState, insertAt, nullptr);
+    }
+
+    static double getChainCpu (tracktion_engine::AudioTrack& track)
+    {
+        double cpu = 0.0;
+
+        for (auto p : track.pluginList)
+            cpu += p->getCpuUsage();
+
+        return cpu;
+    }
+
+    tracktion_engine::AudioTrack* findTrack (const juce::String& id) const
+    {
+        for (auto t : tracktion_engine::getAudioTracks (edit))
+            if (t->itemID.toString() == id)
+                return t;
+
+        return nullptr;
+    }
+
+    void finishFreezing (Render& render, const juce::String& id, const std::function<void (bool)>& onFinished)
+    {
+        freezing.erase (id);
+        render.task.reset();
+        render.copy.reset();
+
+        auto track = findTrack (id);
+
+        if (! render.ok || track == nullptr)
+        {
+            render.file.deleteFile();
+            reportStatus ("Couldn't freeze " + render.trackName);
+
+            if (onFinished != nullptr)
+                onFinished (false);
+
+            return;
+        }
+
+        FrozenTrack frozenTrack;
+        frozenTrack.renderedFile = render.file;
+
+        for (auto c : track->getClips())
+            frozenTrack.clips.push_back (c->state.createCopy());
+
+        auto plugins = track->pluginList.getPlugins();
+
+        for (int i = 0; i < plugins.size(); ++i)
+        {
+            auto p = plugins[i];
+
+            if (dynamic_cast<tracktion_engine::LevelMeterPlugin*> (p) != nullptr)
+                continue;
+
+            edit.flushPluginStateIfNeeded (*p);
+            p->windowState->closeWindowExplicitly();
+            auto state = p->state.createCopy();
+
+            // Live mode may have it bypassed, but it should come back as the user left it
+            if (liveGuard.isBypassedForLatency (*p))
+                state.setProperty (tracktion_engine::IDs::enabled, true, nullptr);
+
+            frozenTrack.plugins.push_back ({ i, state });
+
+            // Anything still holding a reference would keep the instance loaded
+            if (auto cache = getEditorCacheFor (*p))
+                cache->forget (*p);
+
+            if (auto tracker = getStateTrackerFor (*p))
+                tracker->forget (*p);
+
+            liveGuard.forget (*p);
+            pool.forget (*p);
+            p->deleteFromParent();
+        }
+
+        EngineHelpers::loadAudioFileAsClip (*track, render.file);
+        frozen[id] = std::move (frozenTrack);
+
+        if (onFinished != nullptr)
+            onFinished (true);
+
+        // Give the new graph a moment to settle before measuring what it costs
+        juce::Timer::callAfterDelay (2000, [ref = juce::WeakReference<TrackFreezer> (this), name = render.trackName,
+                                            chainCpu = render.chainCpuBefore, deviceCpu = render.deviceCpuBefore,
+                                            audioSeconds = render.audioSeconds, wallSeconds = render.wallSeconds]
+                                           {
+                                               if (auto f = ref.get())
+                                                   f->reportStatus ("Froze " + name + " at " + juce::String (audioSeconds / juce::jmax (0.001, wallSeconds), 1)
+                                                                    + "x realtime. Chain CPU was " + juce::String (chainCpu * 100.0, 1)
+                                                                    + "%, total " + juce::String (deviceCpu * 100.0, 1) + "% -> "
+                                                                    + juce::String (f->edit.engine.getDeviceManager().getCpuUsage() * 100.0, 1) + "%");
+                                           });
+    }
+
+    void reportStatus (const juce::String& status)
+    {
+        if (onStatusChanged != nullptr)
+            onStatusChanged (status);
+    }
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (TrackFreezer)
+    JUCE_DECLARE_NON_COPYABLE (TrackFreezer)
+};
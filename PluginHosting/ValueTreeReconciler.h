@@ -0,0 +1,95 @@
+#pragma once
+
+//==============================================================================
+// Keeps one component per child of a ValueTree, matched up by the children's IDs::id.
+//
+// Instead of clearing and rebuilding everything when the tree changes, reconcile() walks the
+// children in order, keeps components whose key is still present (moving them if the order
+// changed), creates components for new keys and deletes those whose key has gone. Children the
+// create function returns nullptr for are skipped, and tried again on the next reconcile().
+// Nothing here is specific to plugins, so track and clip lists can be driven the same way.
+template <typename ComponentType>
+class ValueTreeReconciler
+{
+public:
+    using CreateFunction = std::function<std::unique_ptr<ComponentType> (const juce::ValueTree&)>;
+
+    struct Changes
+    {
+        int added = 0, removed = 0, moved = 0;
+        bool any() const    { return added + removed + moved > 0; }
+    };
+
+    ValueTreeReconciler (juce::Component& owner, const juce::Identifier& type, CreateFunction create)
+        : parent (owner), childType (type), createComponent (std::move (create))
+    {
+    }
+
+    // Brings the components in line with the children of state, in the same order
+    Changes reconcile (const juce::ValueTree& state)
+    {
+        Changes changes;
+        std::map<juce::String, std::unique_ptr<ComponentType>> previous;
+
+        for (size_t i = 0; i < items.size(); ++i)
+            previous[items[i].key] = std::move (items[i].component);
+
+        std::vector<juce::String> previousOrder;
+
+        for (auto& item : items)
+            previousOrder.push_back (item.key);
+
+        items.clear();
+
+        for (const auto& child : state)
+        {
+            if (! child.hasType (childType))
+                continue;
+
+            const auto key = getKey (child);
+            auto existing = previous.find (key);
+
+            if (existing != previous.end() && existing->second != nullptr)
+            {
+                if (items.size() >= previousOrder.size() || previousOrder[items.size()] != key)
+                    ++changes.moved;
+
+                items.push_back ({ key, std::move (existing->second) });
+                previous.erase (existing);
+            }
+            else if (auto c = createComponent (child))
+            {
+                parent.addAndMakeVisible (*c);
+                items.push_back ({ key, std::move (c) });
+                ++changes.added;
+            }
+        }
+
+        changes.removed = (int) previous.size();
+        return changes;
+    }
+
+    int size() const                                { return (int) items.size(); }
+    ComponentType* operator[] (int index) const     { return juce::isPositiveAndBelow (index, size()) ? items[(size_t) index].component.get() : nullptr; }
+
+    void clear()                                    { items.clear(); }
+
+    static juce::String getKey (const juce::ValueTree& child)
+    {
+        return child[tracktion_engine::IDs::id].toString();
+    }
+
+private:
+    struct Item
+    {
+        juce::String key;
+        std::unique_ptr<ComponentType> component;
+    };
+
+    juce::Component& parent;
+    const juce::Identifier childType;
+    CreateFunction createComponent;
+    std::vector<Item> items;
+
+    JUCE_DECLARE_NON_COPYABLE (ValueTreeReconciler)
+};
@@ -0,0 +1,416 @@
+#pragma once
+
+//==============================================================================
+// A min/max/RMS summary of an audio file at successively coarser resolutions.
+//
+// Level 0 has one bin per baseBinSize samples, and each level above it halves the number of
+// bins, so drawing at any zoom only has to look at about as many bins as there are pixels.
+// Channels are merged: a bin holds the lowest and highest sample across all channels and their
+// combined RMS. Values are stored as 16 bit integers, which is plenty for drawing and keeps the
+// sidecar file to 6 bytes per bin.
+class PeakPyramid
+{
+public:
+    static constexpr int baseBinSize = 256;
+
+    struct Bin
+    {
+        juce::int16 min = 0, max = 0, rms = 0;
+    };
+
+    double sampleRate = 0.0;
+    juce::int64 numSamples = 0;
+    std::vector<std::vector<Bin>> levels;
+
+    //==============================================================================
+    // Reads the whole source, returning nullptr if it can't be read or shouldCancel returns true
+    static std::unique_ptr<PeakPyramid> build (juce::AudioFormatReader& reader, std::function<bool()> shouldCancel)
+    {
+        constexpr int blockSize = baseBinSize * 256;
+        auto pyramid = std::make_unique<PeakPyramid>();
+        pyramid->sampleRate = reader.sampleRate;
+        pyramid->numSamples = reader.lengthInSamples;
+
+        const auto numChannels = (int) reader.numChannels;
+        juce::AudioBuffer<float> block (numChannels, blockSize);
+        juce::HeapBlock<float> squares (baseBinSize);
+        std::vector<Bin> base;
+        base.reserve ((size_t) (reader.lengthInSamples / baseBinSize + 1));
+
+        for (juce::int64 pos = 0; pos < reader.lengthInSamples; pos += blockSize)
+        {
+            if (shouldCancel())
+                return {};
+
+            const auto num = (int) juce::jmin ((juce::int64) blockSize, reader.lengthInSamples - pos);
+
+            reader.read (&block, 0, num, pos, true, true);
+
+            for (int start = 0; start < num; start += baseBinSize)
+            {
+                const auto binSize = juce::jmin (baseBinSize, num - start);
+                auto range = juce::Range<float>::emptyRange (block.getSample (0, start));
+                double sumOfSquares = 0.0;
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                {
+                    auto data = block.getReadPointer (ch, start);
+                    range = range.getUnionWith (juce::FloatVectorOperations::findMinAndMax (data, binSize));
+
+                    juce::FloatVectorOperations::multiply (squares, data, data, binSize);
+                    sumOfSquares += sum (squares, binSize);
+                }
+
+                base.push_back ({ toInt16 (range.getStart()), toInt16 (range.getEnd()),
+                                  toInt16 ((float) std::sqrt (sumOfSquares / (binSize * numChannels))) });
+            }
+        }
+
+        pyramid->levels.push_back (std::move (base));
+
+        while (pyramid->levels.back().size() > 1)
+            pyramid->levels.push_back (halve (pyramid->levels.back()));
+
+        return pyramid;
+    }
+
+    //==============================================================================
+    // Summarises the bins covering [startSample, endSample), using the coarsest level that
+    // still has at least one bin in that range
+    Bin getSummary (juce::int64 startSample, juce::int64 endSample) const
+    {
+        if (levels.empty() || endSample <= startSample)
+            return {};
+
+        size_t level = 0;
+        juce::int64 binSize = baseBinSize;
+
+        while (level + 1 < levels.size() && binSize * 2 <= endSample - startSample)
+        {
+            ++level;
+            binSize *= 2;
+        }
+
+        auto& bins = levels[level];
+        const auto first = (size_t) juce::jlimit ((juce::int64) 0, (juce::int64) bins.size(), startSample / binSize);
+        const auto last  = (size_t) juce::jlimit ((juce::int64) first, (juce::int64) bins.size(), (endSample + binSize - 1) / binSize);
+
+        if (first >= last)
+            return {};
+
+        Bin result = bins[first];
+        double meanSquare = 0.0;
+
+        for (auto i = first; i < last; ++i)
+        {
+            result.min = juce::jmin (result.min, bins[i].min);
+            result.max = juce::jmax (result.max, bins[i].max);
+            meanSquare += (double) bins[i].rms * bins[i].rms;
+        }
+
+        result.rms = (juce::int16) std::sqrt (meanSquare / (double) (last - first));
+        return result;
+    }
+
+    static float toFloat (juce::int16 v)    { return v / 32767.0f; }
+
+    //==============================================================================
+    // The sidecar lives next to the source, or in the temp folder if that isn't writable
+    static juce::File getSidecarFile (const juce::File& source, const juce::File& fallbackFolder)
+    {
+        auto sidecar = source.getSiblingFile (source.getFileName() + ".peaks");
+
+        if (sidecar.existsAsFile() || source.getParentDirectory().hasWriteAccess())
+            return sidecar;
+
+        return fallbackFolder.getChildFile (juce::String::toHexString (source.getFullPathName().hashCode64()) + ".peaks");
+    }
+
+    bool save (const juce::File& sidecar, const juce::File& source) const
+    {
+        juce::TemporaryFile temp (sidecar);
+
+        if (auto out = temp.getFile().createOutputStream())
+        {
+            out->writeInt (magic);
+            out->writeInt64 (source.getSize());
+            out->writeInt64 (source.getLastModificationTime().toMilliseconds());
+            out->writeDouble (sampleRate);
+            out->writeInt64 (numSamples);
+            out->writeInt ((int) levels.size());
+
+            for (auto& level : levels)
+            {
+                out->writeInt ((int) level.size());
+                out->write (level.data(), level.size() * sizeof (Bin));
+            }
+
+            if (! out->getStatus().wasOk())
+                return false;
+        }
+
+        return temp.overwriteTargetFileWithTemporary();
+    }
+
+    // Returns nullptr if the sidecar is missing, damaged or was made from a different version of the source
+    static std::unique_ptr<PeakPyramid> load (const juce::File& sidecar, const juce::File& source)
+    {
+        juce::FileInputStream in (sidecar);
+
+        if (! in.openedOk() || in.readInt() != magic
+             || in.readInt64() != source.getSize()
+             || in.readInt64() != source.getLastModificationTime().toMilliseconds())
+            return {};
+
+        auto pyramid = std::make_unique<PeakPyramid>();
+        pyramid->sampleRate = in.readDouble();
+        pyramid->numSamples = in.readInt64();
+        pyramid->levels.resize ((size_t) juce::jlimit (0, 64, in.readInt()));
+
+        for (auto& level : pyramid->levels)
+        {
+            const auto numBins = in.readInt();
+
+            if (numBins < 0 || (juce::int64) numBins * (juce::int64) sizeof (Bin) > in.getNumBytesRemaining())
+                return {};
+
+            level.resize ((size_t) numBins);
+
+            if (in.read (level.data(), numBins * (int) sizeof (Bin)) != numBins * (int) sizeof (Bin))
+                return {};
+        }
+
+        if (pyramid->levels.empty())
+            return {};
+
+        return pyramid;
+    }
+
+private:
+    static constexpr int magic = 0x31534b50; // "PKS1"
+
+    static juce::int16 toInt16 (float v)
+    {
+        return (juce::int16) juce::roundToInt (juce::jlimit (-1.0f, 1.0f, v) * 32767.0f);
+    }
+
+    // Four independent partial sums, so the compiler can keep them in vector registers
+    static double sum (const float* data, int num)
+    {
+        float s[4] = {};
+        int i = 0;
+
+        for (; i + 4 <= num; i += 4)
+            for (int j = 0; j < 4; ++j)
+                s[j] += data[i + j];
+
+        for (; i < num; ++i)
+            s[0] += data[i];
+
+        return (double) s[0] + s[1] + s[2] + s[3];
+    }
+
+    static std::vector<Bin> halve (const std::vector<Bin>& bins)
+    {
+        std::vector<Bin> result ((bins.size() + 1) / 2);
+
+        for (size_t i = 0; i < result.size(); ++i)
+        {
+            auto& a = bins[i * 2];
+            auto& b = i * 2 + 1 < bins.size() ? bins[i * 2 + 1] : a;
+            const auto meanSquare = ((double) a.rms * a.rms + (double) b.rms * b.rms) / 2.0;
+
+            result[i] = { juce::jmin (a.min, b.min), juce::jmax (a.max, b.max), (juce::int16) std::sqrt (meanSquare) };
+        }
+
+        return result;
+    }
+};
+
+//==============================================================================
+// Draws the first clip on a track from its PeakPyramid. The pyramid is loaded from its sidecar
+// if there's an up-to-date one, otherwise built on a background thread and then saved.
+// The mouse wheel zooms around the pointer, double-clicking shows the whole file again.
+class WaveformComponent : public juce::Component,
+                          private EngineHelpers::FlaggedAsyncUpdater,
+                          private tracktion_engine::ValueTreeAllEventListener
+{
+public:
+    WaveformComponent (tracktion_engine::AudioTrack& t)
+        : track (&t)
+    {
+        track->state.addListener (this);
+        updateSource();
+    }
+
+    ~WaveformComponent() override
+    {
+        track->state.removeListener (this);
+        cancelBuild();
+        builder.removeAllJobs (true, 10000);
+    }
+
+    void paint (juce::Graphics& g) override
+    {
+        g.fillAll (juce::Colours::black.withAlpha (0.6f));
+        auto b = getLocalBounds();
+
+        if (pyramid != nullptr && visibleRange.getLength() > 0)
+        {
+            const auto midY = b.getCentreY();
+            const auto halfHeight = b.getHeight() * 0.5f;
+            const auto samplesPerPixel = (double) visibleRange.getLength() / juce::jmax (1, b.getWidth());
+
+            for (int x = 0; x < b.getWidth(); ++x)
+            {
+                const auto start = visibleRange.getStart() + (juce::int64) (x * samplesPerPixel);
+                const auto end   = juce::jmax (start + 1, visibleRange.getStart() + (juce::int64) ((x + 1) * samplesPerPixel));
+                const auto bin   = pyramid->getSummary (start, end);
+
+                g.setColour (juce::Colours::lightblue.withAlpha (0.7f));
+                g.drawVerticalLine (x, midY - PeakPyramid::toFloat (bin.max) * halfHeight, midY - PeakPyramid::toFloat (bin.min) * halfHeight + 1.0f);
+
+                const auto rms = PeakPyramid::toFloat (bin.rms) * halfHeight;
+                g.setColour (juce::Colours::white.withAlpha (0.8f));
+                g.drawVerticalLine (x, midY - rms, midY + rms + 1.0f);
+            }
+        }
+
+        g.setColour (juce::Colours::white);
+        g.setFont (11.0f);
+        g.drawText (status, b.reduced (4, 2), juce::Justification::topLeft, true);
+    }
+
+    void mouseWheelMove (const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override
+    {
+        // A file no longer than the view is wide is already shown down to single samples
+        if (pyramid == nullptr || getWidth() <= 0 || pyramid->numSamples <= getWidth())
+            return;
+
+        const auto anchor = visibleRange.getStart() + (juce::int64) (visibleRange.getLength() * (double) e.x / getWidth());
+        const auto scale  = std::pow (0.5, wheel.deltaY * 4.0);
+        const auto length = juce::jlimit ((juce::int64) getWidth(), pyramid->numSamples, (juce::int64) (visibleRange.getLength() * scale));
+        const auto start  = anchor - (juce::int64) (length * (double) e.x / getWidth());
+
+        visibleRange = juce::Range<juce::int64> (0, pyramid->numSamples).constrainRange ({ start, start + length });
+        repaint();
+    }
+
+    void mouseDoubleClick (const juce::MouseEvent&) override
+    {
+        if (pyramid != nullptr)
+            visibleRange = { 0, pyramid->numSamples };
+
+        repaint();
+    }
+
+private:
+    tracktion_engine::AudioTrack::Ptr track;
+    juce::File source;
+    std::shared_ptr<const PeakPyramid> pyramid;
+    juce::Range<juce::int64> visibleRange;
+    juce::String status;
+
+    juce::ThreadPool builder { 1 };
+    std::shared_ptr<std::atomic<bool>> buildCancelled;
+    bool needsUpdate = false;
+
+    void updateSource()
+    {
+        juce::File newSource;
+
+        for (auto c : track->getClips())
+        {
+            if (auto wave = dynamic_cast<tracktion_engine::WaveAudioClip*> (c))
+            {
+                newSource = wave->getOriginalFile();
+                break;
+            }
+        }
+
+        if (newSource == source)
+            return;
+
+        cancelBuild();
+        source = newSource;
+        pyramid = nullptr;
+        status = {};
+        repaint();
+
+        if (source.existsAsFile())
+            startLoading();
+    }
+
+    void cancelBuild()
+    {
+        if (buildCancelled != nullptr)
+            buildCancelled->store (true);
+    }
+
+    void startLoading()
+    {
+        auto& engine = track->edit.engine;
+        const auto sidecar = PeakPyramid::getSidecarFile (source, engine.getTemporaryFileManager().getTempDirectory());
+        auto cancelled = std::make_shared<std::atomic<bool>> (false);
+        buildCancelled = cancelled;
+        status = "Building overview...";
+
+        builder.addJob ([sp = SafePointer<WaveformComponent> (this), &formatManager = engine.getAudioFileFormatManager().readFormatManager,
+                         file = source, sidecar, cancelled]
+                        {
+                            const auto startMs = juce::Time::getMillisecondCounterHiRes();
+                            std::shared_ptr<PeakPyramid> result (PeakPyramid::load (sidecar, file));
+                            const bool fromSidecar = result != nullptr;
+
+                            if (! fromSidecar)
+                            {
+                                if (std::unique_ptr<juce::AudioFormatReader> reader { formatManager.createReaderFor (file) })
+                                    result = PeakPyramid::build (*reader, [cancelled] { return cancelled->load(); });
+
+                                if (result != nullptr)
+                                    result->save (sidecar, file);
+                            }
+
+                            const auto ms = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+                            juce::MessageManager::callAsync ([sp, file, result, fromSidecar, ms, cancelled]
+                                                             {
+                                                                 if (sp != nullptr && ! cancelled->load() && sp->source == file)
+                                                                     sp->setPyramid (result, (fromSidecar ? "Overview loaded in " : "Overview built in ")
+                                                                                                 + juce::String (ms, 1) + " ms");
+                                                             });
+                        });
+        repaint();
+    }
+
+    void setPyramid (std::shared_ptr<const PeakPyramid> p, const juce::String& newStatus)
+    {
+        pyramid = std::move (p);
+        status = pyramid != nullptr ? newStatus : juce::String ("Couldn't read " + source.getFileName());
+
+        if (pyramid != nullptr)
+            visibleRange = { 0, pyramid->numSamples };
+
+        repaint();
+    }
+
+    void valueTreeChanged() override {}
+
+    void valueTreeChildAdded (juce::ValueTree& p, juce::ValueTree&) override
+    {
+        if (p == track->state)
+            markAndUpdate (needsUpdate);
+    }
+
+    void valueTreeChildRemoved (juce::ValueTree& p, juce::ValueTree&, int) override
+    {
+        if (p == track->state)
+            markAndUpdate (needsUpdate);
+    }
+
+    void handleAsyncUpdate() override
+    {
+        if (compareAndReset (needsUpdate))
+            updateSource();
+    }
+};